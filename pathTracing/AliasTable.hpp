@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Walker 别名表：按给定权重对 [0, n) 中的下标做离散采样，构建 O(n)，每次采样 O(1)
+// 每个槽位 i 保存一个阈值 prob 和一个别名 alias：先均匀选槽位，
+// 再以 prob 的概率取 i 本身，否则取 alias
+class AliasTable
+{
+public:
+    AliasTable() = default;
+    explicit AliasTable(const std::vector<float>& weights) { build(weights); }
+
+    void build(const std::vector<float>& weights)
+    {
+        size_t n = weights.size();
+        bins.assign(n, Bin());
+        double sum = 0;
+        for (float w : weights)
+            sum += w;
+        if (n == 0 || sum <= 0) {
+            bins.clear();
+            return;
+        }
+
+        // 把每个权重缩放为 n * p_i，小于 1 的放入 small，大于等于 1 的放入 large
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            bins[i].pdf = float(weights[i] / sum);
+            scaled[i] = weights[i] / sum * n;
+            (scaled[i] < 1.0 ? small : large).push_back((uint32_t)i);
+        }
+        // 每次用一个大槽位填满一个小槽位
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back(); small.pop_back();
+            uint32_t l = large.back(); large.pop_back();
+            bins[s].prob = (float)scaled[s];
+            bins[s].alias = l;
+            scaled[l] -= 1.0 - scaled[s];
+            (scaled[l] < 1.0 ? small : large).push_back(l);
+        }
+        // 剩下的槽位（含浮点误差）都取自身
+        for (uint32_t i : small) { bins[i].prob = 1.0f; bins[i].alias = i; }
+        for (uint32_t i : large) { bins[i].prob = 1.0f; bins[i].alias = i; }
+    }
+
+    // u 为 [0,1) 上的均匀随机数，返回采样到的下标，pdf 为该下标被选中的概率
+    uint32_t sample(float u, float& pdf) const
+    {
+        float x = u * bins.size();
+        uint32_t i = std::min((uint32_t)x, (uint32_t)bins.size() - 1);
+        const Bin& b = bins[i];
+        uint32_t k = (x - i < b.prob) ? i : b.alias;
+        pdf = bins[k].pdf;
+        return k;
+    }
+
+    // 用两个均匀随机数采样，适用于槽位很多的表（例如网格的每个三角形一个槽位）：
+    // 采样器给出的 float 只有 24 位，单个 float 乘以槽位数后，槽位的选取和剩下的小数部分（与阈值比较）都不准确。
+    // 这里把 u、v 拼成一个 48 位的随机数，用 double（53 位有效数字）计算槽位和小数部分
+    uint32_t sample(float u, float v, float& pdf) const
+    {
+        double x = (u + v * (1.0 / 16777216.0)) * bins.size();
+        uint32_t i = std::min((uint32_t)x, (uint32_t)bins.size() - 1);
+        const Bin& b = bins[i];
+        uint32_t k = (x - i < b.prob) ? i : b.alias;
+        pdf = bins[k].pdf;
+        return k;
+    }
+
+    // 下标 i 被选中的概率
+    float pmf(uint32_t i) const { return bins[i].pdf; }
+    size_t size() const { return bins.size(); }
+    bool empty() const { return bins.empty(); }
+
+private:
+    struct Bin
+    {
+        float prob = 1.0f;  // 取自身的概率阈值
+        uint32_t alias = 0; // 另一个候选下标
+        float pdf = 0.0f;   // 归一化后的权重，采样时与 prob 放在同一缓存行里
+    };
+    std::vector<Bin> bins;
+};
@@ -1,19 +1,139 @@
 #include <algorithm>
 #include <cassert>
+#include <functional>
+#include <thread>
 #include "BVH.hpp"
 
+// SAH 分桶数量以及遍历一个内部节点相对于求交一个物体的代价
+static constexpr int kSAHBuckets = 16;
+static constexpr double kTraversalCost = 0.125;
+// 物体数不少于该值的子树才交给新线程构建，更小的子树开线程的开销比收益大
+static constexpr int kParallelBuildThreshold = 4096;
+// 遍历栈放在栈上的项数：树的深度不超过它时不需要额外分配（朴素划分的深度约为 log2(物体数)，
+// SAH 和 LBVH 的树可能更深，例如 LBVH 最多 63 位 Morton 码再加上重复码的 log2(个数)）
+static constexpr int kTraversalStackSize = 64;
+
+// 在 numThreads 个线程上执行 job(线程编号)，只有一个线程时直接在当前线程执行
+static void parallelFor(int numThreads, const std::function<void(int)>& job)
+{
+    if (numThreads <= 1) {
+        job(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t)
+        threads.emplace_back(job, t);
+    for (auto& thread : threads)
+        thread.join();
+}
+
 BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
-                   SplitMethod splitMethod)
+                   SplitMethod splitMethod, int width)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
       primitives(std::move(p))
+{
+    build(width);
+}
+
+BVHAccel::BVHAccel(Object* mesh, Material* material, const Vector3f* vertices, const uint32_t* indices, uint32_t numTriangles,
+                   int maxPrimsInNode, SplitMethod splitMethod, int width)
+    : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
+      mesh(mesh), material(material), meshVertices(vertices), meshIndices(indices), triangleIndex(numTriangles)
+{
+    build(width);
+}
+
+BVHAccel::BVHAccel(Object* mesh, Material* material, const Vector3f* vertices, const uint32_t* indices,
+                   std::vector<uint32_t> triangleOrder, std::vector<LinearBVHNode> nodes,
+                   int maxPrimsInNode, SplitMethod splitMethod, int width)
+    : nodes(std::move(nodes)), maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
+      mesh(mesh), material(material), meshVertices(vertices), meshIndices(indices), triangleIndex(std::move(triangleOrder))
+{
+    updateTriangles();
+    finishBuild(width);
+    builtCost = SAHCost();
+}
+
+Bounds3 BVHAccel::primitiveBounds(int i) const
+{
+    if (!mesh)
+        return primitives[i]->getBounds();
+    const uint32_t* v = &meshIndices[3 * (size_t)triangleIndex[i]];
+    return Union(Bounds3(meshVertices[v[0]], meshVertices[v[1]]), meshVertices[v[2]]);
+}
+
+float BVHAccel::primitiveArea(int i) const
+{
+    if (!mesh)
+        return primitives[i]->getArea();
+    return crossProduct(triangles[i].e1, triangles[i].e2).norm() * 0.5f;
+}
+
+void BVHAccel::updateTriangles()
+{
+    triangles.resize(triangleIndex.size());
+    for (size_t i = 0; i < triangleIndex.size(); ++i) {
+        const uint32_t* v = &meshIndices[3 * (size_t)triangleIndex[i]];
+        TriangleData& tri = triangles[i];
+        tri.v0 = meshVertices[v[0]];
+        tri.e1 = meshVertices[v[1]] - tri.v0;
+        tri.e2 = meshVertices[v[2]] - tri.v0;
+    }
+}
+
+void BVHAccel::build(int width)
 {
     time_t start, stop;
     time(&start);
-    if (primitives.empty())
+    int n = primitiveCount();
+    if (n == 0)
         return;
 
+    // 预先计算每个物体的包围盒和质心，构建过程只在下标数组上原地划分；
+    // 三角形网格每次都从原始编号顺序开始构建，重新构建的结果与新建的 BVH 相同
+    if (mesh)
+        for (int i = 0; i < n; ++i)
+            triangleIndex[i] = i;
+    primInfo.resize(n);
+    buildIndices.resize(n);
+    for (int i = 0; i < n; ++i) {
+        primInfo[i].bounds = primitiveBounds(i);
+        primInfo[i].centroid = primInfo[i].bounds.Centroid();
+        buildIndices[i] = i;
+    }
+
     // 构建BVH加速结构
-    root = recursiveBuild(primitives);
+    spareThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    if (splitMethod == SplitMethod::LBVH)
+        sortByMortonCode();
+    buildNodes.resize(2 * (size_t)n - 1); // n 个物体的二叉树最多 2n - 1 个节点
+    usedBuildNodes = 0;
+    BVHBuildNode* root = recursiveBuild(0, n);
+
+    // 叶子中的物体在 buildIndices 中已经连续存放，按它重排 primitives（三角形网格重排三角形编号和求交数据）
+    if (mesh) {
+        for (int i = 0; i < n; ++i)
+            triangleIndex[i] = buildIndices[i];
+        updateTriangles();
+    }
+    else {
+        std::vector<Object*> ordered(n);
+        for (int i = 0; i < n; ++i)
+            ordered[i] = primitives[buildIndices[i]];
+        primitives.swap(ordered);
+    }
+    std::vector<BVHPrimitiveInfo>().swap(primInfo);
+    std::vector<int>().swap(buildIndices);
+    std::vector<uint64_t>().swap(mortonCodes);
+
+    // 压平为连续数组，之后构建树就不再需要了
+    nodes.resize(usedBuildNodes);
+    int offset = 0;
+    flattenBVHTree(root, &offset);
+    std::vector<BVHBuildNode>().swap(buildNodes);
+
+    finishBuild(width);
+    builtCost = SAHCost();
 
     time(&stop);
     double diff = difftime(stop, start);
@@ -22,149 +142,606 @@ BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
     int secs = (int)diff - (hrs * 3600) - (mins * 60);
 
     printf(
-        "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
-        hrs, mins, secs);
+        "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n"
+        "Split: %s, primitives: %i, SAH cost: %.2f, width: %i (%s)\n\n",
+        hrs, mins, secs, splitMethod == SplitMethod::SAH ? "SAH" : splitMethod == SplitMethod::LBVH ? "LBVH" : "NAIVE",
+        n, builtCost, bvh8 ? 8 : bvh4 ? 4 : 2,
+        bvh8 ? simdLevelName(bvh8->simd) : bvh4 ? simdLevelName(bvh4->simd) : "scalar");
+}
+
+void BVHAccel::finishBuild(int width)
+{
+    this->width = width;
+    buildWide(width);
+
+    // 树的最大深度：子节点总在父节点之后，按顺序扫描一遍即可
+    std::vector<int> depth(nodes.size(), 0);
+    maxDepth = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        maxDepth = std::max(maxDepth, depth[i]);
+        if (nodes[i].nPrimitives == 0)
+            depth[i + 1] = depth[nodes[i].secondChildOffset] = depth[i] + 1;
+    }
+
+    // 总面积（大网格的三角形很多，用 double 累加）；面积分布等到第一次 Sample 时再构建
+    double sum = 0;
+    for (int i = 0; i < primitiveCount(); ++i)
+        sum += primitiveArea(i);
+    area = (float)sum;
+    areaDistribution = AliasTable();
+    areaDistributionBuilt = false;
+}
+
+void BVHAccel::buildAreaDistribution()
+{
+    std::lock_guard<std::mutex> lock(areaDistributionMutex);
+    if (areaDistributionBuilt.load(std::memory_order_relaxed))
+        return;
+    std::vector<float> areas(primitiveCount());
+    for (size_t i = 0; i < areas.size(); ++i)
+        areas[i] = primitiveArea((int)i);
+    areaDistribution.build(areas);
+    areaDistributionBuilt.store(true, std::memory_order_release);
 }
 
-BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
+BVHBuildNode* BVHAccel::createLeaf(BVHBuildNode* node, int start, int end)
+{
+    // 叶子节点中的物体在 primitives 中连续存放，区间为 [firstPrimOffset, firstPrimOffset + nPrimitives)
+    node->firstPrimOffset = start;
+    node->nPrimitives = end - start;
+    Bounds3 bounds;
+    for (int i = start; i < end; ++i)
+        bounds = Union(bounds, primInfo[buildIndices[i]].bounds);
+    node->bounds = bounds;
+    node->left = nullptr;
+    node->right = nullptr;
+    return node;
+}
+
+BVHBuildNode* BVHAccel::recursiveBuild(int start, int end)
 {
     // 递归构建BVH加速结构
-    BVHBuildNode* node = new BVHBuildNode();
+    BVHBuildNode* node = &buildNodes[usedBuildNodes.fetch_add(1)];
+    int n = end - start;
+    int* indices = buildIndices.data();
 
     // Compute bounds of all primitives in BVH node
-    // 计算包围盒
+    // 计算包围盒（LBVH 的划分不需要它，节点包围盒在子节点建好后自底向上合并）
     Bounds3 bounds;
-    for (int i = 0; i < objects.size(); ++i)
-        bounds = Union(bounds, objects[i]->getBounds());
-    if (objects.size() == 1) {
+    if (splitMethod != SplitMethod::LBVH)
+        for (int i = start; i < end; ++i)
+            bounds = Union(bounds, primInfo[indices[i]].bounds);
+    if (n == 1 || (splitMethod != SplitMethod::SAH && n <= maxPrimsInNode)) {
         // Create leaf _BVHBuildNode_
         // 创建叶子节点
-        node->bounds = objects[0]->getBounds();
-        node->object = objects[0];
-        node->left = nullptr;
-        node->right = nullptr;
-        node->area = objects[0]->getArea();
-        return node;
-    }
-    else if (objects.size() == 2) {
-        // 创建包含两个子节点的节点
-        node->left = recursiveBuild(std::vector{objects[0]});
-        node->right = recursiveBuild(std::vector{objects[1]});
+        return createLeaf(node, start, end);
+    }
 
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
-        return node;
+    int mid;
+    if (n == 2 && splitMethod == SplitMethod::NAIVE) {
+        // 创建包含两个子节点的节点
+        // 按质心相距最远的轴排好两个物体的顺序，便于遍历时先访问近的一侧
+        const Vector3f& c0 = primInfo[indices[start]].centroid;
+        const Vector3f& c1 = primInfo[indices[start + 1]].centroid;
+        node->splitAxis = Bounds3(c0, c1).maxExtent();
+        if (c1[node->splitAxis] < c0[node->splitAxis])
+            std::swap(indices[start], indices[start + 1]);
+        mid = start + 1;
+    }
+    else if (splitMethod == SplitMethod::LBVH) {
+        // 已按 Morton 码排序，直接在最高的不同位上二分
+        mid = splitMorton(start, end, node->splitAxis);
+    }
+    else if (splitMethod == SplitMethod::SAH) {
+        // SAH 认为不划分更划算时直接生成叶子节点
+        if (!splitSAH(start, end, bounds, node->splitAxis, mid))
+            return createLeaf(node, start, end);
     }
     else {
-        // 选择最长边作为分割维度，对物体进行排序
+        // 选择质心跨度最大的轴作为分割维度，按质心中位数划分（只需要找出中位数，不必完整排序）
         Bounds3 centroidBounds;
-        for (int i = 0; i < objects.size(); ++i)
-            centroidBounds =
-                Union(centroidBounds, objects[i]->getBounds().Centroid());
+        for (int i = start; i < end; ++i)
+            centroidBounds = Union(centroidBounds, primInfo[indices[i]].centroid);
         int dim = centroidBounds.maxExtent();
-        switch (dim) {
-        case 0:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().x <
-                       f2->getBounds().Centroid().x;
-            });
-            break;
-        case 1:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().y <
-                       f2->getBounds().Centroid().y;
-            });
-            break;
-        case 2:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().z <
-                       f2->getBounds().Centroid().z;
-            });
-            break;
+        node->splitAxis = dim;
+        mid = start + n / 2;
+        std::nth_element(indices + start, indices + mid, indices + end, [this, dim](int a, int b) {
+            return primInfo[a].centroid[dim] < primInfo[b].centroid[dim];
+        });
+    }
+
+    assert(start < mid && mid < end);
+
+    // 两侧在下标数组中互不重叠，可以并行构建：较大的子树在空闲线程上构建左侧，当前线程构建右侧
+    bool parallel = false;
+    if (n >= kParallelBuildThreshold) {
+        parallel = spareThreads.fetch_sub(1) > 0;
+        if (!parallel)
+            spareThreads.fetch_add(1);
+    }
+    if (parallel) {
+        std::thread worker([&]() { node->left = recursiveBuild(start, mid); });
+        node->right = recursiveBuild(mid, end);
+        worker.join();
+        spareThreads.fetch_add(1);
+    }
+    else {
+        node->left = recursiveBuild(start, mid);
+        node->right = recursiveBuild(mid, end);
+    }
+
+    node->bounds = Union(node->left->bounds, node->right->bounds);
+    return node;
+}
+
+bool BVHAccel::splitSAH(int start, int end, const Bounds3& bounds, int& axis, int& mid)
+{
+    /**
+     * @brief 分桶 SAH：在三个轴上各把质心包围盒均分为 kSAHBuckets 个桶，
+     * 代价 = kTraversalCost + (左侧物体数 * 左侧表面积 + 右侧物体数 * 右侧表面积) / 节点表面积，
+     * 叶子代价 = 物体数。物体数超过 maxPrimsInNode 时必须划分。
+     */
+    int n = end - start;
+    int* indices = buildIndices.data();
+    Bounds3 centroidBounds;
+    for (int i = start; i < end; ++i)
+        centroidBounds = Union(centroidBounds, primInfo[indices[i]].centroid);
+
+    struct Bucket {
+        int count = 0;
+        Bounds3 bounds;
+    };
+
+    // 三个轴的分桶在同一次遍历中完成
+    Bucket buckets[3][kSAHBuckets];
+    double scale[3];
+    for (int dim = 0; dim < 3; ++dim) {
+        double extent = centroidBounds.pMax[dim] - centroidBounds.pMin[dim];
+        scale[dim] = extent > 0 ? kSAHBuckets / extent : 0;
+    }
+    for (int i = start; i < end; ++i) {
+        const BVHPrimitiveInfo& info = primInfo[indices[i]];
+        for (int dim = 0; dim < 3; ++dim) {
+            if (scale[dim] == 0)
+                continue;
+            int k = (int)((info.centroid[dim] - centroidBounds.pMin[dim]) * scale[dim]);
+            k = std::min(std::max(k, 0), kSAHBuckets - 1);
+            buckets[dim][k].count++;
+            buckets[dim][k].bounds = Union(buckets[dim][k].bounds, info.bounds);
         }
+    }
 
-        auto beginning = objects.begin();
-        auto middling = objects.begin() + (objects.size() / 2);
-        auto ending = objects.end();
+    double bestCost = std::numeric_limits<double>::infinity();
+    int bestDim = -1, bestSplit = 0;
+    double invArea = 1.0 / std::max(bounds.SurfaceArea(), 1e-12);
 
-        auto leftshapes = std::vector<Object*>(beginning, middling);
-        auto rightshapes = std::vector<Object*>(middling, ending);
+    for (int dim = 0; dim < 3; ++dim) {
+        // 所有质心在该轴上重合，无法划分
+        if (scale[dim] == 0)
+            continue;
 
-        assert(objects.size() == (leftshapes.size() + rightshapes.size()));
+        // 从右往左扫描，得到每个划分位置右侧的物体数和包围盒表面积
+        double rightArea[kSAHBuckets];
+        int rightCount[kSAHBuckets];
+        Bounds3 acc;
+        int count = 0;
+        for (int k = kSAHBuckets - 1; k > 0; --k) {
+            acc = Union(acc, buckets[dim][k].bounds);
+            count += buckets[dim][k].count;
+            rightArea[k] = count ? acc.SurfaceArea() : 0;
+            rightCount[k] = count;
+        }
 
-        node->left = recursiveBuild(leftshapes);
-        node->right = recursiveBuild(rightshapes);
+        // 从左往右扫描，计算在第 k 个桶之后划分的代价
+        acc = Bounds3();
+        count = 0;
+        for (int k = 0; k < kSAHBuckets - 1; ++k) {
+            acc = Union(acc, buckets[dim][k].bounds);
+            count += buckets[dim][k].count;
+            if (count == 0 || rightCount[k + 1] == 0)
+                continue;
+            double cost = kTraversalCost +
+                (count * acc.SurfaceArea() + rightCount[k + 1] * rightArea[k + 1]) * invArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestDim = dim;
+                bestSplit = k;
+            }
+        }
+    }
 
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
+    if (bestDim == -1) {
+        // 质心全部重合：能放进一个叶子就做叶子，否则按中位数强制划分
+        if (n <= maxPrimsInNode)
+            return false;
+        axis = bounds.maxExtent();
+        mid = start + n / 2;
+        return true;
     }
 
-    return node;
+    if (n <= maxPrimsInNode && bestCost >= n)
+        return false;
+
+    axis = bestDim;
+    double cmin = centroidBounds.pMin[bestDim], s = scale[bestDim];
+    mid = (int)(std::partition(indices + start, indices + end, [&](int index) {
+        int k = (int)((primInfo[index].centroid[bestDim] - cmin) * s);
+        return std::min(std::max(k, 0), kSAHBuckets - 1) <= bestSplit;
+    }) - indices);
+    return true;
+}
+
+// 把 21 位整数的每一位之间插入两个 0，三个轴交错后得到 63 位 Morton 码
+static uint64_t expandBits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+// 对 (keys, values) 按 keys 做 LSD 基数排序，每遍 11 位；同一遍内按线程分块统计直方图、并行分发，
+// 所有键在某一遍的数字都相同时跳过该遍
+static void radixSort(std::vector<uint64_t>& keys, std::vector<int>& values, int numThreads)
+{
+    constexpr int kBits = 11, kBuckets = 1 << kBits;
+    size_t n = keys.size();
+    numThreads = (int)std::max<size_t>(1, std::min<size_t>(numThreads, n / 65536));
+    std::vector<uint64_t> keysTmp(n);
+    std::vector<int> valuesTmp(n);
+    std::vector<size_t> histogram((size_t)numThreads * kBuckets);
+
+    for (int shift = 0; shift < 64; shift += kBits) {
+        // 每个线程统计自己那一段的直方图
+        std::fill(histogram.begin(), histogram.end(), 0);
+        parallelFor(numThreads, [&](int t) {
+            size_t* h = &histogram[(size_t)t * kBuckets];
+            for (size_t i = n * t / numThreads, e = n * (t + 1) / numThreads; i < e; ++i)
+                h[(keys[i] >> shift) & (kBuckets - 1)]++;
+        });
+
+        // 前缀和：数字 d 在线程 t 中的写入起点 = 所有线程中比 d 小的数字总数 + 线程 t 之前的线程中 d 的个数
+        size_t offset = 0;
+        bool trivial = false;
+        for (int d = 0; d < kBuckets; ++d) {
+            size_t count = 0;
+            for (int t = 0; t < numThreads; ++t) {
+                size_t c = histogram[(size_t)t * kBuckets + d];
+                histogram[(size_t)t * kBuckets + d] = offset + count;
+                count += c;
+            }
+            trivial |= count == n;
+            offset += count;
+        }
+        if (trivial)
+            continue;
+
+        parallelFor(numThreads, [&](int t) {
+            size_t* h = &histogram[(size_t)t * kBuckets];
+            for (size_t i = n * t / numThreads, e = n * (t + 1) / numThreads; i < e; ++i) {
+                size_t dst = h[(keys[i] >> shift) & (kBuckets - 1)]++;
+                keysTmp[dst] = keys[i];
+                valuesTmp[dst] = values[i];
+            }
+        });
+        keys.swap(keysTmp);
+        values.swap(valuesTmp);
+    }
+}
+
+void BVHAccel::sortByMortonCode()
+{
+    // 把质心量化到质心包围盒内 2^21 x 2^21 x 2^21 的网格上
+    Bounds3 centroidBounds;
+    for (const BVHPrimitiveInfo& info : primInfo)
+        centroidBounds = Union(centroidBounds, info.centroid);
+    const double kCells = (1 << 21) - 1;
+    double scale[3];
+    for (int dim = 0; dim < 3; ++dim) {
+        double extent = centroidBounds.pMax[dim] - centroidBounds.pMin[dim];
+        scale[dim] = extent > 0 ? kCells / extent : 0;
+    }
+
+    size_t n = buildIndices.size();
+    mortonCodes.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const Vector3f& c = primInfo[buildIndices[i]].centroid;
+        uint64_t q[3];
+        for (int dim = 0; dim < 3; ++dim)
+            q[dim] = (uint64_t)std::min(std::max((c[dim] - centroidBounds.pMin[dim]) * scale[dim], 0.0), kCells);
+        mortonCodes[i] = (expandBits(q[0]) << 2) | (expandBits(q[1]) << 1) | expandBits(q[2]);
+    }
+    radixSort(mortonCodes, buildIndices, spareThreads + 1);
+}
+
+int BVHAccel::splitMorton(int start, int end, int& axis) const
+{
+    uint64_t diff = mortonCodes[start] ^ mortonCodes[end - 1];
+    if (diff == 0) {
+        // 质心落在同一个网格单元中，只能按中位数划分
+        axis = 0;
+        return start + (end - start) / 2;
+    }
+    // 区间已排序且最高的不同位之上的位都相同，该位为 0 的码都排在为 1 的码前面
+    int bit = 63;
+    while (!((diff >> bit) & 1))
+        --bit;
+    uint64_t mask = 1ULL << bit;
+    axis = 2 - bit % 3; // x 占第 2、5、8... 位，y 占第 1、4、7... 位，z 占第 0、3、6... 位
+    return (int)(std::partition_point(mortonCodes.begin() + start, mortonCodes.begin() + end,
+                                      [mask](uint64_t code) { return !(code & mask); }) - mortonCodes.begin());
+}
+
+bool BVHAccel::refit(float maxCostGrowth)
+{
+    if (nodes.empty())
+        return false;
+    if (mesh)
+        updateTriangles(); // 顶点缓冲已经更新
+
+    // 深度优先压平后每棵子树在 nodes 中占一段连续区间，且子节点都在父节点之后。
+    // 把树切成若干棵互不相交的子树并行重算（每段倒序遍历即为自底向上），剩下的上层节点最后串行重算
+    int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    int grain = std::max<int>(kParallelBuildThreshold, (int)nodes.size() / (4 * numThreads));
+    std::vector<std::pair<int, int> > subtrees; // [第一个节点, 最后一个节点 + 1)
+    std::vector<int> upper;                     // 上层节点，先序
+    std::vector<std::pair<int, int> > stack{ { 0, (int)nodes.size() } };
+    while (!stack.empty()) {
+        auto [first, end] = stack.back();
+        stack.pop_back();
+        if (end - first <= grain || nodes[first].nPrimitives > 0) {
+            subtrees.push_back({ first, end });
+            continue;
+        }
+        upper.push_back(first);
+        stack.push_back({ nodes[first].secondChildOffset, end });
+        stack.push_back({ first + 1, nodes[first].secondChildOffset });
+    }
+
+    auto refitNode = [this](int i) {
+        LinearBVHNode& node = nodes[i];
+        if (node.nPrimitives > 0) {
+            Bounds3 bounds;
+            for (int k = 0; k < node.nPrimitives; ++k)
+                bounds = Union(bounds, primitiveBounds(node.primitivesOffset + k));
+            node.bounds = bounds;
+        }
+        else {
+            node.bounds = Union(nodes[i + 1].bounds, nodes[node.secondChildOffset].bounds);
+        }
+    };
+    numThreads = std::min<int>(numThreads, (int)subtrees.size());
+    parallelFor(numThreads, [&](int t) {
+        for (size_t s = t; s < subtrees.size(); s += numThreads)
+            for (int i = subtrees[s].second - 1; i >= subtrees[s].first; --i)
+                refitNode(i);
+    });
+    for (auto it = upper.rbegin(); it != upper.rend(); ++it)
+        refitNode(*it);
+
+    // 物体移动后原来的划分可能变得很差：SAH 代价增长超过阈值时按当前位置重新构建
+    if (maxCostGrowth > 0 && SAHCost() > builtCost * maxCostGrowth) {
+        build(width);
+        return true;
+    }
+    finishBuild(width);
+    return false;
+}
+
+void BVHAccel::buildWide(int width)
+{
+    bvh4.reset();
+    bvh8.reset();
+    if (width <= 2 || nodes.empty())
+        return;
+
+    SimdLevel simd = detectSimdLevel();
+    if (width >= 8 && simd == SimdLevel::AVX2) {
+        bvh8.reset(new WideBVH<8>());
+        bvh8->simd = simd;
+        bvh8->build(nodes);
+    }
+    else {
+        bvh4.reset(new WideBVH<4>());
+        bvh4->simd = simd;
+        bvh4->build(nodes);
+    }
+}
+
+int BVHAccel::flattenBVHTree(BVHBuildNode* node, int* offset)
+{
+    // 深度优先压平：第一个子节点紧跟在父节点之后，第二个子节点的位置记录在父节点中
+    LinearBVHNode* linearNode = &nodes[*offset];
+    linearNode->bounds = node->bounds;
+    int myOffset = (*offset)++;
+    if (node->left == nullptr && node->right == nullptr) {
+        linearNode->primitivesOffset = node->firstPrimOffset;
+        linearNode->nPrimitives = (uint16_t)node->nPrimitives;
+        linearNode->axis = 0;
+    }
+    else {
+        linearNode->axis = (uint8_t)node->splitAxis;
+        linearNode->nPrimitives = 0;
+        flattenBVHTree(node->left, offset);
+        linearNode->secondChildOffset = flattenBVHTree(node->right, offset);
+    }
+    return myOffset;
 }
 
+double BVHAccel::SAHCost() const
+{
+    // 内部节点代价为 kTraversalCost * 表面积，叶子为物体数 * 表面积，最后除以根节点表面积
+    if (nodes.empty())
+        return 0;
+    double cost = 0;
+    for (const LinearBVHNode& node : nodes) {
+        if (node.nPrimitives > 0)
+            cost += node.nPrimitives * node.bounds.SurfaceArea();
+        else
+            cost += kTraversalCost * node.bounds.SurfaceArea();
+    }
+    return cost / std::max(nodes[0].bounds.SurfaceArea(), 1e-12);
+}
+
+Bounds3 BVHAccel::WorldBound() const
+{
+    return nodes.empty() ? Bounds3() : nodes[0].bounds;
+}
+
+BVHAccel::~BVHAccel() {}
+
 Intersection BVHAccel::Intersect(const Ray& ray) const
 {
     // 光线与BVH加速结构中物体的相交测试，返回相交信息
+    if (bvh8) return bvh8->Intersect(ray, *this);
+    if (bvh4) return bvh4->Intersect(ray, *this);
+
     Intersection isect;
-    if (!root)
+    if (nodes.empty())
         return isect;
-    isect = BVHAccel::getIntersection(root, ray);
+
+    // 判断光线方向各分量是否为正（与 Bounds3::IntersectP 的约定一致）
+    std::array<int, 3> dirIsNeg{ int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0) };
+
+    // 待访问节点栈
+    // 栈中最多同时有 maxDepth 个待访问节点，树太深时改用堆上的栈
+    int stackBuffer[kTraversalStackSize];
+    std::unique_ptr<int[]> deepStack;
+    int* nodesToVisit = stackBuffer;
+    if (maxDepth > kTraversalStackSize) {
+        deepStack.reset(new int[maxDepth]);
+        nodesToVisit = deepStack.get();
+    }
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    float tClosest = std::numeric_limits<float>::infinity();
+    while (true)
+    {
+        const LinearBVHNode& node = nodes[currentNodeIndex];
+        // 包围盒进入点比当前最近交点还远时，整棵子树都可以跳过
+        if (node.bounds.IntersectP(ray, ray.direction_inv, dirIsNeg, tClosest))
+        {
+            if (node.nPrimitives > 0)
+            {
+                // 叶子节点中可能有多个物体，取最近的交点
+                if (intersectLeaf(ray, node.primitivesOffset, node.nPrimitives, isect))
+                    tClosest = (float)isect.distance;
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+            else
+            {
+                // 第一个子节点在分割轴上坐标较小，光线沿该轴正向时先访问它，否则先访问第二个子节点
+                if (dirIsNeg[node.axis])
+                {
+                    nodesToVisit[toVisitOffset++] = node.secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+                else
+                {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node.secondChildOffset;
+                }
+            }
+        }
+        else
+        {
+            if (toVisitOffset == 0) break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
     return isect;
 }
 
-Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
+bool BVHAccel::IntersectP(const Ray& ray, float tMax) const
 {
-    /**
-     * @brief 最终获取场景中某个三角形和该光线的交点信息
-     */
-	// TODO Traverse the BVH to find intersection
-    Intersection inter;
-
-	// 光线方向
-	float x = ray.direction.x;
-	float y = ray.direction.y;
-	float z = ray.direction.z;
-	// 判断坐标是否为负
-	std::array<int, 3> dirsIsNeg{ int(x > 0),int(y > 0),int(z > 0) };
+    // 阴影射线只关心是否被遮挡，遇到第一个遮挡物就返回，不需要比较远近
+    if (bvh8) return bvh8->IntersectP(ray, tMax, *this);
+    if (bvh4) return bvh4->IntersectP(ray, tMax, *this);
 
-	// 判断结点的包围盒与光线是否相交
-	if (node->bounds.IntersectP(ray, ray.direction_inv, dirsIsNeg) == false) return inter;
+    if (nodes.empty())
+        return false;
 
-	if (node->left == nullptr && node->right == nullptr)
-	{
-		inter = node->object->getIntersection(ray);
-		return inter;
-	}
+    std::array<int, 3> dirIsNeg{ int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0) };
 
-	// 递归判断子节点是否存在与光线相交的情况
-	auto hit1 = getIntersection(node->left, ray);
-	auto hit2 = getIntersection(node->right, ray);
-
-	if (hit1.distance < hit2.distance)
-		return hit1;
-	return hit2;
+    // 栈中最多同时有 maxDepth 个待访问节点，树太深时改用堆上的栈
+    int stackBuffer[kTraversalStackSize];
+    std::unique_ptr<int[]> deepStack;
+    int* nodesToVisit = stackBuffer;
+    if (maxDepth > kTraversalStackSize) {
+        deepStack.reset(new int[maxDepth]);
+        nodesToVisit = deepStack.get();
+    }
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    while (true)
+    {
+        const LinearBVHNode& node = nodes[currentNodeIndex];
+        if (node.bounds.IntersectP(ray, ray.direction_inv, dirIsNeg, tMax))
+        {
+            if (node.nPrimitives > 0)
+            {
+                if (occludedLeaf(ray, node.primitivesOffset, node.nPrimitives, tMax))
+                    return true;
+                if (toVisitOffset == 0) break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            }
+            else
+            {
+                if (dirIsNeg[node.axis])
+                {
+                    nodesToVisit[toVisitOffset++] = node.secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+                else
+                {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node.secondChildOffset;
+                }
+            }
+        }
+        else
+        {
+            if (toVisitOffset == 0) break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    return false;
 }
 
+void BVHAccel::Intersect(const Ray* rays, Intersection* hits, size_t count) const
+{
+    for (size_t i = 0; i < count; ++i)
+        hits[i] = Intersect(rays[i]);
+}
 
-void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf){
-     // 通过 p 来划分 BVH 中的对象，并对该对象进行一个采样
+void BVHAccel::IntersectP(const Ray* rays, const float* tMax, char* occluded, size_t count) const
+{
+    for (size_t i = 0; i < count; ++i)
+        occluded[i] = IntersectP(rays[i], tMax[i]);
+}
 
-    //当前节点为叶子节点叶子节点
-    if(node->left == nullptr || node->right == nullptr){
-        //在三角形中随机采样
-        node->object->Sample(pos, pdf);
-        pdf *= node->area;
+void BVHAccel::Sample(Intersection &pos, float &pdf, Sampler &sampler){
+    // 按面积比例选出一个物体：查别名表，选中的概率为 pick
+    if (!areaDistributionBuilt.load(std::memory_order_acquire))
+        buildAreaDistribution();
+    Vector2f u = sampler.get2D();
+    float pick;
+    uint32_t k = areaDistribution.sample(u.x, u.y, pick);
+    if (mesh) {
+        // 在三角形内均匀取点，选中三角形的概率为 该三角形面积/总面积，因此 pdf = 1/总面积
+        const TriangleData& tri = triangles[k];
+        u = sampler.get2D();
+        float x = std::sqrt(u.x), y = u.y;
+        pos.coords = tri.v0 + tri.e1 * (x * (1.0f - y)) + tri.e2 * (x * y);
+        pos.normal = tri.normal();
+        pos.emit = material->getEmission();
+        pdf = 1.0f / area;
         return;
     }
-    if(p < node->left->area) getSample(node->left, p, pos, pdf);
-    else getSample(node->right, p - node->left->area, pos, pdf);
+    //在该物体上随机采样，pdf 为 1/该物体面积
+    primitives[k]->Sample(pos, pdf, sampler);
+    //选中该物体的概率为 该物体面积/总面积，因此 pdf = 1/总面积
+    pdf *= pick;
 }
-
-void BVHAccel::Sample(Intersection &pos, float &pdf){
-    // p 是 bvh树 中的一个划分
-    float p = std::sqrt(get_random_float()) * root->area;
-    //采样
-    getSample(root, p, pos, pdf);
-
-    pdf /= root->area;
-}
\ No newline at end of file
@@ -5,16 +5,69 @@
 #include <atomic>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <ctime>
 #include "Object.hpp"
 #include "Ray.hpp"
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "WideBVH.hpp"
+#include "AliasTable.hpp"
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
-struct BVHPrimitiveInfo;
+// 构建时预先算好的物体包围盒和质心，划分时不再反复调用虚函数 getBounds()
+struct BVHPrimitiveInfo {
+    Bounds3 bounds;
+    Vector3f centroid;
+};
+
+// 线性化（压平）后的 BVH 节点，32 字节，按深度优先顺序连续存放在数组中：
+// 内部节点的第一个子节点紧跟在自己后面，第二个子节点的位置由 secondChildOffset 给出
+struct LinearBVHNode {
+    Bounds3 bounds; // 节点包围盒（24 字节）
+    union {
+        int primitivesOffset;  // 叶子节点：第一个物体在 primitives 中的位置
+        int secondChildOffset; // 内部节点：第二个子节点在 nodes 中的位置
+    };
+    uint16_t nPrimitives; // 叶子节点中的物体数量，0 表示内部节点
+    uint8_t axis;         // 内部节点的分割轴，用于决定先访问哪个子节点
+    uint8_t pad[1];       // 补齐到 32 字节
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode should be 32 bytes");
+
+// 网格三角形求交用的预计算数据（36 字节），按 BVH 叶子顺序连续存放，遍历叶子时顺序读取。
+// 法线不保存，只在命中或采样时由两条边的叉积算出
+struct TriangleData {
+    Vector3f v0;     // 第一个顶点
+    Vector3f e1, e2; // 两条边 v1 - v0、v2 - v0
+
+    // 单位法线
+    Vector3f normal() const { return normalize(crossProduct(e1, e2)); }
+
+    // 与 Triangle::getIntersection 相同的 Möller-Trumbore 测试（同样剔除背面），命中时返回距离 t
+    bool intersect(const Ray& ray, double& t) const
+    {
+        Vector3f pvec = crossProduct(ray.direction, e2);
+        // det = -dot(dir, e1 x e2)：det < 0 即光线从背面射入，与 |det| 过小（平行）一起剔除
+        double det = dotProduct(e1, pvec);
+        if (det < EPSILON)
+            return false;
+        double det_inv = 1. / det;
+        Vector3f tvec = ray.origin - v0;
+        double u = dotProduct(tvec, pvec) * det_inv;
+        if (u < 0 || u > 1)
+            return false;
+        Vector3f qvec = crossProduct(tvec, e1);
+        double v = dotProduct(ray.direction, qvec) * det_inv;
+        if (v < 0 || u + v > 1)
+            return false;
+        t = dotProduct(e2, qvec) * det_inv;
+        return t >= 0;
+    }
+};
+static_assert(sizeof(TriangleData) == 36, "TriangleData should be 36 bytes");
 
 // BVHAccel Declarations
 // BVH加速器类
@@ -23,39 +76,115 @@ class BVHAccel {
 
 public:
     // BVHAccel Public Types
-    // 分割方法：NAIVE（朴素）和SAH（表面积启发式）
-    enum class SplitMethod { NAIVE, SAH };
+    // 分割方法：NAIVE（朴素）、SAH（表面积启发式）和 LBVH（按质心的 Morton 码排序后逐位划分，构建最快）
+    enum class SplitMethod { NAIVE, SAH, LBVH };
+
+    // 构建器版本，写入网格缓存：修改 LinearBVHNode 的布局或构建算法（改变叶子顺序或节点数组）时加一，
+    // 旧版本写出的缓存随之失效
+    static constexpr uint32_t builderVersion = 1;
 
     // BVHAccel Public Methods
-    // 构造函数，传入物体集合p、每个节点的最大物体数目maxPrimsInNode和分割方法splitMethod
-    BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
+    // 构造函数，传入物体集合p、每个节点的最大物体数目maxPrimsInNode和分割方法splitMethod，
+    // width 为 4 或 8 时再把二叉树折叠为 4 叉（SSE）/ 8 叉（AVX2）BVH 用于求交（不支持 AVX2 时 8 退回 4）
+    BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE, int width = 2);
+    // 三角形网格模式：物体是 mesh 的 numTriangles 个三角形，顶点缓冲 vertices 和下标缓冲 indices 由网格持有（不拷贝，网格变形后调用 refit）。
+    // 叶子引用三角形编号，求交只读取按叶子顺序排列的 triangles，不经过虚函数；交点的物体为 mesh，材质为 material
+    BVHAccel(Object* mesh, Material* material, const Vector3f* vertices, const uint32_t* indices, uint32_t numTriangles,
+             int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE, int width = 2);
+    // 三角形网格模式下使用预先构建好的 BVH（网格缓存）：triangleOrder 为叶子顺序对应的三角形编号
+    BVHAccel(Object* mesh, Material* material, const Vector3f* vertices, const uint32_t* indices,
+             std::vector<uint32_t> triangleOrder, std::vector<LinearBVHNode> nodes,
+             int maxPrimsInNode, SplitMethod splitMethod, int width = 2);
     // 获取整个场景的边界
     Bounds3 WorldBound() const;
+    // 物体移动或变形后，保持树结构不变、自底向上（并行）重新计算所有节点的包围盒，并更新多叉 BVH 和面积分布。
+    // maxCostGrowth > 0 时检查树的质量：SAH 代价超过构建时的 maxCostGrowth 倍则按当前位置重新构建，返回 true
+    bool refit(float maxCostGrowth = 0);
     ~BVHAccel();
 
     // 光线与场景中物体的相交测试，返回相交信息
+    // 使用固定大小的栈迭代遍历线性 BVH，先访问近的子节点，并用当前最近交点距离剔除更远的节点
     Intersection Intersect(const Ray &ray) const;
 
-    // 最终获取场景中某个三角形和该光线的交点信息
-    Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
-    // 光线与场景中物体的相交测试，返回是否相交
-    bool IntersectP(const Ray &ray) const;
-    // BVH根节点指针
-    BVHBuildNode* root;
+    // 光线与场景中物体的相交测试，返回在 [0, tMax) 范围内是否有遮挡（找到任意一个交点即返回）
+    bool IntersectP(const Ray &ray, float tMax) const;
+    // 批量版本：一次处理 count 条光线（波前积分器使用）。
+    // 目前只是逐条调用单光线遍历，没有光线包遍历、光线排序或共享的遍历工作，
+    // 作为接口保留，以后可以在这里换成真正的批量遍历而不必修改调用方
+    void Intersect(const Ray* rays, Intersection* hits, size_t count) const;
+    void IntersectP(const Ray* rays, const float* tMax, char* occluded, size_t count) const;
+    // 叶子中从 first 开始的 count 个物体求交，找到比 isect 更近的交点时更新 isect 并返回 true
+    bool intersectLeaf(const Ray& ray, int first, int count, Intersection& isect) const;
+    // 叶子中从 first 开始的 count 个物体是否在 [0, tMax) 范围内遮挡光线
+    bool occludedLeaf(const Ray& ray, int first, int count, float tMax) const;
+    // 物体（三角形网格模式下为三角形）数量
+    int primitiveCount() const { return mesh ? (int)triangleIndex.size() : (int)primitives.size(); }
+    // 压平后的 BVH 节点数组，nodes[0] 为根节点
+    std::vector<LinearBVHNode> nodes;
+    // 多叉 BVH（可选），存在时 Intersect / IntersectP 使用它
+    std::unique_ptr<WideBVH<4> > bvh4;
+    std::unique_ptr<WideBVH<8> > bvh8;
+    // 根据 width 构建多叉 BVH
+    void buildWide(int width);
+    // nodes 和 primitives 就绪后，构建多叉 BVH，计算树的最大深度和总面积
+    void finishBuild(int width);
+    // 构建面积分布（第一次 Sample 时调用，多个线程同时调用时只构建一次）
+    void buildAreaDistribution();
 
     // BVHAccel Private Methods
-    // 递归构建BVH加速结构，传入物体集合objects
-    BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    // 对所有物体构建整棵树（构造函数和 refit 触发的重新构建使用）
+    void build(int width);
+    // 递归构建 buildIndices[start, end) 范围内物体的子树：原地划分下标数组，不复制物体集合；
+    // 足够大的子树交给新线程并行构建
+    BVHBuildNode* recursiveBuild(int start, int end);
+    // 用分桶的表面积启发式（SAH）寻找最优划分并原地划分 [start, end)，划分位置写入 mid；
+    // 返回 false 表示应当直接作为叶子节点
+    bool splitSAH(int start, int end, const Bounds3& bounds, int& axis, int& mid);
+    // LBVH：计算质心的 63 位 Morton 码，并按 Morton 码对 buildIndices 做（并行）基数排序
+    void sortByMortonCode();
+    // LBVH：在 [start, end) 中 Morton 码第一个不同的位上划分，返回划分位置
+    int splitMorton(int start, int end, int& axis) const;
+    // 创建叶子节点，叶子中的物体就是 buildIndices[start, end)
+    BVHBuildNode* createLeaf(BVHBuildNode* node, int start, int end);
+    // 把构建树按深度优先顺序压平到 nodes 中，返回该节点在 nodes 中的位置
+    int flattenBVHTree(BVHBuildNode* node, int* offset);
+    // 计算整棵树的 SAH 代价（用于比较不同划分方法的质量）
+    double SAHCost() const;
+    // 第 i 个物体（按当前顺序）的包围盒和面积
+    Bounds3 primitiveBounds(int i) const;
+    float primitiveArea(int i) const;
+    // 三角形网格模式：按 triangleIndex 的顺序从顶点缓冲重新计算 triangles
+    void updateTriangles();
 
     // BVHAccel Private Data
     const int maxPrimsInNode;// 每个节点的最大物体数目
     const SplitMethod splitMethod;// 分割方法
-    std::vector<Object*> primitives; // 物体集合
-
-    // 获取节点在整个加速结构中的采样点和采样概率
-    void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
-    // 对整个加速结构进行采样，返回采样点和采样概率
-    void Sample(Intersection &pos, float &pdf);
+    std::vector<Object*> primitives; // 物体集合（构建完成后按叶子顺序排列），三角形网格模式下为空
+    // 三角形网格模式
+    Object* mesh = nullptr;              // 三角形所属的网格，非空表示三角形网格模式
+    Material* material = nullptr;        // 网格的材质
+    const Vector3f* meshVertices = nullptr; // 网格的顶点缓冲
+    const uint32_t* meshIndices = nullptr;  // 网格的下标缓冲，每个三角形三个顶点下标
+    std::vector<uint32_t> triangleIndex; // 叶子顺序 -> 三角形编号
+    std::vector<TriangleData> triangles; // 按叶子顺序排列的三角形求交数据
+    std::vector<BVHPrimitiveInfo> primInfo; // 构建过程中使用：每个物体预先算好的包围盒和质心
+    std::vector<int> buildIndices;           // 构建过程中使用：物体下标，划分时原地重排，构建完成后即为叶子顺序
+    std::vector<uint64_t> mortonCodes;       // LBVH 构建过程中使用：与 buildIndices 一一对应的已排序 Morton 码
+    std::vector<BVHBuildNode> buildNodes;    // 构建过程中使用：构建树节点的存储，避免逐个 new / delete
+    std::atomic<int> usedBuildNodes{0};      // buildNodes 中已分配的节点数
+    std::atomic<int> spareThreads{0};        // 构建过程中还可以额外启动的线程数
+    // 物体（按叶子顺序）按面积比例的离散分布，O(1) 采样物体。每个物体占 12 字节，
+    // 只有被当作光源采样的网格才需要，因此第一次 Sample 时才构建，重新构建或 refit 后作废
+    AliasTable areaDistribution;
+    std::atomic<bool> areaDistributionBuilt{false};
+    std::mutex areaDistributionMutex;
+    float area = 0; // 所有物体的表面积之和
+    int width = 2;  // 多叉 BVH 的宽度
+    int maxDepth = 0; // 二叉树的最大深度（根节点为 0），决定遍历栈的大小
+    double builtCost = 0; // 构建完成时的 SAH 代价，refit 用它判断树的质量是否退化
+
+    // 对整个加速结构进行采样，返回采样点和采样概率（按面积均匀采样，pdf = 1 / 总面积）
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler);
 };
 
 // BVH构建节点结构体
@@ -63,8 +192,6 @@ struct BVHBuildNode {
     Bounds3 bounds; // 节点边界
     BVHBuildNode* left; // 左子节点
     BVHBuildNode* right; // 右子节点
-    Object* object; // 关联的物体指针
-    float area; // 物体表面积
 
 public:
     int splitAxis=0, firstPrimOffset=0, nPrimitives=0; // 分割轴，首个物体偏移量，物体数量
@@ -72,10 +199,53 @@ public:
     BVHBuildNode(){
         bounds = Bounds3();
         left = nullptr;right = nullptr;
-        object = nullptr;
     }
 };
 
+inline bool BVHAccel::intersectLeaf(const Ray& ray, int first, int count, Intersection& isect) const
+{
+    bool found = false;
+    if (!mesh) {
+        for (int i = first; i < first + count; ++i) {
+            Intersection hit = primitives[i]->getIntersection(ray);
+            if (hit.happened && hit.distance < isect.distance) {
+                isect = hit;
+                found = true;
+            }
+        }
+        return found;
+    }
+    for (int i = first; i < first + count; ++i) {
+        double t;
+        if (triangles[i].intersect(ray, t) && t < isect.distance) {
+            isect.happened = true;
+            isect.distance = t;
+            isect.coords = ray(t);
+            isect.normal = triangles[i].normal();
+            isect.m = material;
+            isect.obj = mesh;
+            found = true;
+        }
+    }
+    return found;
+}
+
+inline bool BVHAccel::occludedLeaf(const Ray& ray, int first, int count, float tMax) const
+{
+    if (!mesh) {
+        for (int i = first; i < first + count; ++i)
+            if (primitives[i]->intersectP(ray, tMax))
+                return true;
+        return false;
+    }
+    for (int i = first; i < first + count; ++i) {
+        double t;
+        if (triangles[i].intersect(ray, t) && t < tMax)
+            return true;
+    }
+    return false;
+}
+
 
 
 
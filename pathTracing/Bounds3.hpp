@@ -95,6 +95,9 @@ class Bounds3
     //射线和bounds是否有相交
     inline bool IntersectP(const Ray& ray, const Vector3f& invDir,
                            const std::array<int, 3>& dirisNeg) const;
+    //射线和bounds是否在 [0, tMax] 范围内相交（tMax 通常为当前最近交点的距离）
+    inline bool IntersectP(const Ray& ray, const Vector3f& invDir,
+                           const std::array<int, 3>& dirisNeg, float tMax) const;
 };
 
 
@@ -124,6 +127,25 @@ inline bool Bounds3::IntersectP(const Ray& ray, const Vector3f& invDir, const st
 	return tEnter <= tExit && tExit >= 0;
 }
 
+// 射线和包围盒是否在 [0, tMax] 范围内相交，进入点比 tMax 还远的包围盒可以直接跳过
+inline bool Bounds3::IntersectP(const Ray& ray, const Vector3f& invDir, const std::array<int, 3>& dirIsNeg, float tMax) const
+{
+	float tEnter = -std::numeric_limits<float>::infinity();
+	float tExit = tMax;
+	for (int i = 0; i < 3; i++)
+	{
+		float min = (pMin[i] - ray.origin[i]) * invDir[i];
+		float max = (pMax[i] - ray.origin[i]) * invDir[i];
+		if (!dirIsNeg[i])
+		{
+			std::swap(min, max);
+		}
+		tEnter = std::max(min, tEnter);
+		tExit = std::min(max, tExit);
+	}
+	return tEnter <= tExit && tExit >= 0;
+}
+
 // 计算两个包围盒的并集
 inline Bounds3 Union(const Bounds3& b1, const Bounds3& b2)
 {
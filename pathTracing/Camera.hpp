@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cmath>
+#include "Vector.hpp"
+#include "Ray.hpp"
+#include "global.hpp"
+
+// 针孔 / 薄透镜相机：由位置、注视点、上方向、竖直视场角和分辨率确定。
+// 构造时预先算出像素 (0, 0) 左上角对应的方向以及沿图像 x、y 方向每个像素的方向增量，
+// 生成主光线时只需两次乘加，不再每个像素重新计算三角函数和坐标变换
+class Camera
+{
+public:
+    // fov 为竖直视场角（度）；aperture > 0 时为薄透镜相机，aperture 为透镜半径，
+    // focusDistance 为对焦距离（沿视线方向），<= 0 时对焦在注视点上
+    Camera(const Vector3f& position, const Vector3f& lookAt, const Vector3f& up,
+           float fov, int width, int height, float aperture = 0, float focusDistance = 0)
+        : width(width), height(height), fov(fov), position(position), aperture(aperture)
+    {
+        forward = normalize(lookAt - position);
+        right = normalize(crossProduct(forward, up)); // 与原先 (-x, y, 1) 的约定一致：+x 指向图像右侧
+        this->up = crossProduct(right, forward);
+        this->focusDistance = focusDistance > 0 ? focusDistance : dotProduct(lookAt - position, forward);
+
+        aspect = width / (float)height;
+        float scale = std::tan(fov * 0.5f * M_PI / 180.0f);
+        topLeft = forward - right * (aspect * scale) + this->up * scale;
+        dx = right * (2 * aspect * scale / width);
+        dy = this->up * (-2 * scale / height);
+    }
+
+    // 图像平面上连续坐标 (x, y) 处的主光线，像素 (i, j) 的中心为 (i + 0.5, j + 0.5)。
+    // lens 为 [0,1)^2 上的均匀样本，只有薄透镜相机会用到
+    Ray generateRay(float x, float y, const Vector2f& lens = Vector2f(0.5f, 0.5f)) const
+    {
+        Vector3f dir = topLeft + dx * x + dy * y;
+        if (aperture <= 0)
+            return Ray(position, normalize(dir));
+
+        // 薄透镜：光线从透镜上的一点出发，穿过对焦平面上与针孔光线相同的点
+        Vector2f p = sampleDisk(lens);
+        Vector3f origin = position + (right * p.x + up * p.y) * aperture;
+        Vector3f focus = position + dir * focusDistance; // dir 沿视线方向的分量为 1
+        return Ray(origin, normalize(focus - origin));
+    }
+
+    bool hasLens() const { return aperture > 0; }
+
+    int width, height;
+    float fov, aspect;
+    Vector3f position;
+    Vector3f forward, right, up; // 相机坐标系
+    float aperture;              // 透镜半径，0 为针孔相机
+    float focusDistance;         // 对焦距离
+
+private:
+    // 同心圆映射（Shirley-Chiu）：把 [0,1)^2 均匀映射到单位圆盘上
+    static Vector2f sampleDisk(const Vector2f& u)
+    {
+        float ox = 2 * u.x - 1, oy = 2 * u.y - 1;
+        if (ox == 0 && oy == 0)
+            return Vector2f(0, 0);
+        float r, theta;
+        if (std::fabs(ox) > std::fabs(oy)) {
+            r = ox;
+            theta = M_PI / 4 * (oy / ox);
+        } else {
+            r = oy;
+            theta = M_PI / 2 - M_PI / 4 * (ox / oy);
+        }
+        return Vector2f(r * std::cos(theta), r * std::sin(theta));
+    }
+
+    Vector3f topLeft; // 图像左上角（像素 (0, 0) 的左上角）对应的方向，沿视线方向的分量为 1
+    Vector3f dx, dy;  // 图像 x、y 方向上每个像素的方向增量
+};
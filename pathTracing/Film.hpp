@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "Vector.hpp"
+#include "global.hpp"
+
+// 胶片（累积缓冲区）：每个像素用 double 累加辐射度，并记录该像素已完成的采样数，
+// 渐进式渲染每一遍把新采样累加进来，任何时刻都可以用 sum / count 得到当前图像。
+// 另外累加每个采样各分量的平方，用于估计像素的方差，并记录自适应采样的收敛状态
+class Film
+{
+public:
+    Film(int width, int height)
+        : width(width), height(height), sum(3 * (size_t)width * height, 0.0),
+          sumSq(3 * (size_t)width * height, 0.0), count((size_t)width * height, 0),
+          checkedAt((size_t)width * height, 0), converged((size_t)width * height, 0)
+    {}
+
+    // 把像素 pixel 的一个采样累加进缓冲区（分块互不重叠，同一像素只会被一个线程写入）
+    void addSample(int pixel, const Vector3f& L)
+    {
+        double* s = &sum[3 * (size_t)pixel];
+        double* sq = &sumSq[3 * (size_t)pixel];
+        s[0] += L.x;
+        s[1] += L.y;
+        s[2] += L.z;
+        sq[0] += (double)L.x * L.x;
+        sq[1] += (double)L.y * L.y;
+        sq[2] += (double)L.z * L.z;
+        count[pixel]++;
+    }
+
+    // 像素 (i, j) 的相对误差：在以它为中心、半径 radius 的窗口内汇总各像素均值的方差（方差 / 采样数），
+    // 每个分量取 sqrt(窗口内平均方差) / (窗口内平均亮度 + delta)，返回三个分量中的最大值。
+    // 单个像素采样较少时方差估计本身噪声很大（没采到光源的像素看起来已经收敛），在窗口内汇总可以抑制这种误判；
+    // delta 避免接近全黑的区域因为分母很小而一直采样。窗口内有采样数不足 2 的像素时返回无穷大
+    double relativeError(int i, int j, int radius, double delta) const
+    {
+        double variance[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+        int pixels = 0;
+        for (int y = std::max(0, j - radius); y <= std::min(height - 1, j + radius); ++y) {
+            for (int x = std::max(0, i - radius); x <= std::min(width - 1, i + radius); ++x) {
+                size_t m = (size_t)y * width + x;
+                uint32_t n = count[m];
+                if (n < 2)
+                    return std::numeric_limits<double>::infinity();
+                for (int c = 0; c < 3; ++c) {
+                    double mu = sum[3 * m + c] / n;
+                    mean[c] += mu;
+                    variance[c] += std::max(0.0, (sumSq[3 * m + c] - n * mu * mu) / (n - 1)) / n;
+                }
+                pixels++;
+            }
+        }
+        double error = 0;
+        for (int c = 0; c < 3; ++c)
+            error = std::max(error, std::sqrt(variance[c] / pixels) / (mean[c] / pixels + delta));
+        return error;
+    }
+
+    // 像素 pixel 当前的辐射度估计
+    Vector3f pixelValue(int pixel) const
+    {
+        uint32_t n = count[pixel];
+        if (n == 0)
+            return Vector3f(0.0f);
+        const double* s = &sum[3 * (size_t)pixel];
+        return Vector3f(float(s[0] / n), float(s[1] / n), float(s[2] / n));
+    }
+
+    // 色调映射（gamma 校正后映射到 0-255）并写出 PPM；先写临时文件再替换（replaceFile），
+    // 预览图被查看或渲染进程被中止时不会留下写了一半的文件。写入失败时返回 false
+    bool writePPM(const std::string& path) const
+    {
+        std::string tmp = path + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "wb");
+        if (!fp)
+            return false;
+        bool ok = fprintf(fp, "P6\n%d %d\n255\n", width, height) > 0;
+        std::vector<unsigned char> row(3 * (size_t)width);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                Vector3f c = pixelValue(j * width + i);
+                row[3 * i + 0] = (unsigned char)(255 * std::pow(clamp(0, 1, c.x), 0.6f));
+                row[3 * i + 1] = (unsigned char)(255 * std::pow(clamp(0, 1, c.y), 0.6f));
+                row[3 * i + 2] = (unsigned char)(255 * std::pow(clamp(0, 1, c.z), 0.6f));
+            }
+            ok = ok && fwrite(row.data(), 1, row.size(), fp) == row.size();
+        }
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return replaceFile(tmp, path);
+    }
+
+    // 写出检查点：文件头（魔数、版本、分辨率、采样器种子、场景哈希）+ 每像素采样数 + 累加和 + 平方和
+    // + 自适应采样状态（最近一次判断收敛时的采样数、是否已收敛）。
+    // 同样先写临时文件再替换（replaceFile），写到一半被抢占时旧的检查点仍然完整
+    bool writeCheckpoint(const std::string& path, uint64_t seed, uint64_t sceneHash) const
+    {
+        std::string tmp = path + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "wb");
+        if (!fp)
+            return false;
+        CheckpointHeader header;
+        header.width = width;
+        header.height = height;
+        header.seed = seed;
+        header.sceneHash = sceneHash;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+               && fwrite(count.data(), sizeof(uint32_t), count.size(), fp) == count.size()
+               && fwrite(sum.data(), sizeof(double), sum.size(), fp) == sum.size()
+               && fwrite(sumSq.data(), sizeof(double), sumSq.size(), fp) == sumSq.size()
+               && fwrite(checkedAt.data(), sizeof(uint32_t), checkedAt.size(), fp) == checkedAt.size()
+               && fwrite(converged.data(), sizeof(uint8_t), converged.size(), fp) == converged.size();
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return replaceFile(tmp, path);
+    }
+
+    // 读取检查点，返回文件中的采样器种子和场景哈希；文件不存在、格式或分辨率不符时返回 false 且不修改缓冲区
+    bool readCheckpoint(const std::string& path, uint64_t& seed, uint64_t& sceneHash)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp)
+            return false;
+        CheckpointHeader header, expected;
+        std::vector<uint32_t> c(count.size()), checked(checkedAt.size());
+        std::vector<double> s(sum.size()), sq(sumSq.size());
+        std::vector<uint8_t> conv(converged.size());
+        bool ok = fread(&header, sizeof(header), 1, fp) == 1
+               && !memcmp(header.magic, expected.magic, sizeof(header.magic)) && header.version == expected.version
+               && header.width == width && header.height == height
+               && fread(c.data(), sizeof(uint32_t), c.size(), fp) == c.size()
+               && fread(s.data(), sizeof(double), s.size(), fp) == s.size()
+               && fread(sq.data(), sizeof(double), sq.size(), fp) == sq.size()
+               && fread(checked.data(), sizeof(uint32_t), checked.size(), fp) == checked.size()
+               && fread(conv.data(), sizeof(uint8_t), conv.size(), fp) == conv.size();
+        fclose(fp);
+        if (!ok)
+            return false;
+        count.swap(c);
+        sum.swap(s);
+        sumSq.swap(sq);
+        checkedAt.swap(checked);
+        converged.swap(conv);
+        seed = header.seed;
+        sceneHash = header.sceneHash;
+        return true;
+    }
+
+    // 所有像素中最少的采样数
+    uint32_t minCount() const
+    {
+        return count.empty() ? 0 : *std::min_element(count.begin(), count.end());
+    }
+
+    int width, height;
+    std::vector<double> sum;     // 每个像素 RGB 三个分量的累加和
+    std::vector<double> sumSq;   // 每个像素采样 RGB 三个分量的平方和
+    std::vector<uint32_t> count; // 每个像素已完成的采样数
+    std::vector<uint32_t> checkedAt; // 自适应采样：每个像素最近一次判断收敛时的采样数
+    std::vector<uint8_t> converged;  // 自适应采样：像素已收敛，不再采样
+
+private:
+    struct CheckpointHeader
+    {
+        char magic[4] = {'P', 'T', 'C', 'K'};
+        uint32_t version = 3;
+        int32_t width = 0, height = 0;
+        uint64_t seed = 0;
+        uint64_t sceneHash = 0;
+    };
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Vector.hpp"
+#include "global.hpp"
+
+// 像素重建滤波器类型
+enum FilterType { BOX_FILTER, TENT_FILTER, BLACKMAN_HARRIS_FILTER };
+
+// 像素重建滤波器（可分离，x、y 两个方向使用同一个一维滤波器）。
+// 不把每个采样按滤波器权重泼洒（splat）到周围像素，而是按滤波器本身的形状对像素内的采样偏移做重要性采样，
+// 每个采样的权重恒为 1、只累加到自己的像素：对非负滤波器两者的期望相同，
+// 但没有跨分块的写冲突，像素值仍只依赖本像素的采样（检查点、自适应采样的确定性不受影响）
+class PixelFilter
+{
+public:
+    // radius <= 0 时使用该滤波器的默认半径（box 0.5，tent 1，Blackman-Harris 1.5 像素）
+    explicit PixelFilter(FilterType type = BOX_FILTER, float radius = 0)
+        : type(type)
+    {
+        static const float defaultRadius[] = { 0.5f, 1.0f, 1.5f };
+        this->radius = radius > 0 ? radius : defaultRadius[type];
+        if (type == BLACKMAN_HARRIS_FILTER)
+            buildTable();
+    }
+
+    // 一维滤波器值，x 为相对像素中心的偏移（像素）
+    float evaluate(float x) const
+    {
+        if (std::fabs(x) > radius)
+            return 0.0f;
+        switch (type) {
+            case BOX_FILTER:
+                return 1.0f;
+            case TENT_FILTER:
+                return radius - std::fabs(x);
+            case BLACKMAN_HARRIS_FILTER:
+            {
+                float t = 2 * M_PI * (x + radius) / (2 * radius);
+                return 0.35875f - 0.48829f * std::cos(t) + 0.14128f * std::cos(2 * t) - 0.01168f * std::cos(3 * t);
+            }
+        }
+        return 0.0f;
+    }
+
+    // 把 [0,1)^2 上的均匀样本变换为按滤波器分布的像素内偏移（相对像素中心，单位为像素）
+    Vector2f sample(const Vector2f& u) const
+    {
+        return Vector2f(sample1D(u.x), sample1D(u.y));
+    }
+
+    FilterType getType() const { return type; }
+    float getRadius() const { return radius; }
+
+private:
+    float sample1D(float u) const
+    {
+        switch (type) {
+            case BOX_FILTER:
+                return (2 * u - 1) * radius;
+            case TENT_FILTER:
+                // 三角形分布的逆 CDF
+                return u < 0.5f ? radius * (std::sqrt(2 * u) - 1) : radius * (1 - std::sqrt(2 - 2 * u));
+            case BLACKMAN_HARRIS_FILTER:
+            {
+                // 在分段常数表上反解 CDF
+                size_t i = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+                i = std::min(std::max<size_t>(i, 1), cdf.size() - 1) - 1;
+                float du = cdf[i + 1] - cdf[i];
+                float t = du > 0 ? (u - cdf[i]) / du : 0.5f;
+                return ((i + t) / (cdf.size() - 1) * 2 - 1) * radius;
+            }
+        }
+        return 0.0f;
+    }
+
+    // 没有解析逆 CDF 的滤波器：把 [-radius, radius] 等分成 tableSize 段，按分段常数近似建立 CDF
+    void buildTable()
+    {
+        const int tableSize = 256;
+        cdf.assign(tableSize + 1, 0.0f);
+        for (int i = 0; i < tableSize; ++i) {
+            float x = ((i + 0.5f) / tableSize * 2 - 1) * radius;
+            cdf[i + 1] = cdf[i] + evaluate(x);
+        }
+        for (float& c : cdf)
+            c /= cdf[tableSize];
+    }
+
+    FilterType type;
+    float radius;
+    std::vector<float> cdf; // BLACKMAN_HARRIS_FILTER 的采样表
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include "Object.hpp"
+#include "Transform.hpp"
+
+// 实例：用一个 3x4 变换把共享的原型物体（通常是带有自己 BVH 的 MeshTriangle）放到场景中。
+// 多个实例共享同一个原型，网格数据和网格 BVH（底层加速结构）只保存一份；
+// 场景 BVH 按实例的世界空间包围盒建立，作为顶层加速结构。
+// 求交时把光线变换到原型的局部空间并把方向归一化（三角形求交的平行判定使用绝对阈值，
+// 方向长度随缩放变化会导致漏交），交点距离再换算回世界空间。
+// 原型本身不加入场景；三角形网格的原型应使用与场景相近的尺度建模，过小的三角形在局部空间同样无法求交
+class Instance : public Object
+{
+public:
+    Instance(Object* prototype, const Transform& toWorld)
+        : prototype(prototype), toWorld(toWorld), toObject(toWorld.inverse())
+    {
+        // 面积只在相似变换（旋转、平移、均匀缩放）下准确，发光实例的光源采样依赖它
+        areaScale = std::pow(std::fabs(toWorld.determinant()), 2.0f / 3.0f);
+    }
+
+    bool intersect(const Ray&) { return true; }
+
+    bool intersect(const Ray&, float &, uint32_t &) const { return false; }
+
+    Intersection getIntersection(Ray ray)
+    {
+        float scale;
+        Intersection inter = prototype->getIntersection(toLocal(ray, scale));
+        if (inter.happened) {
+            inter.distance /= scale;
+            inter.coords = ray(inter.distance);
+            inter.normal = normalize(toObject.transposeVector(inter.normal));
+            inter.obj = this; // 光源分布中登记的是实例本身
+        }
+        return inter;
+    }
+
+    bool intersectP(const Ray& ray, float tMax)
+    {
+        float scale;
+        Ray local = toLocal(ray, scale);
+        return prototype->intersectP(local, tMax * scale);
+    }
+
+    void getSurfaceProperties(const Vector3f &P, const Vector3f &I, const uint32_t &index, const Vector2f &uv, Vector3f &N, Vector2f &st) const
+    {
+        prototype->getSurfaceProperties(toObject.point(P), toObject.vector(I), index, uv, N, st);
+        N = normalize(toObject.transposeVector(N));
+    }
+
+    Vector3f evalDiffuseColor(const Vector2f &st) const { return prototype->evalDiffuseColor(st); }
+
+    // 包围盒和面积每次由原型的当前值计算：原型变形（MeshTriangle::updateVertices）后 Scene::refitBVH 即可得到新值
+    Bounds3 getBounds() { return toWorld.bounds(prototype->getBounds()); }
+
+    float getArea() { return prototype->getArea() * areaScale; }
+
+    // 在原型上采样后变换到世界空间
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler)
+    {
+        prototype->Sample(pos, pdf, sampler);
+        pos.coords = toWorld.point(pos.coords);
+        pos.normal = normalize(toObject.transposeVector(pos.normal));
+        pdf = 1.0f / getArea();
+    }
+
+    bool hasEmit() { return prototype->hasEmit(); }
+
+    Material* getMaterial() { return prototype->getMaterial(); }
+
+    Object* prototype;  // 共享的原型物体
+    Transform toWorld;  // 局部空间到世界空间
+    Transform toObject; // 世界空间到局部空间
+
+private:
+    // 局部空间的光线，scale 为局部空间距离与世界空间距离之比（世界空间光线方向为单位向量）
+    Ray toLocal(const Ray& ray, float& scale) const
+    {
+        Vector3f dir = toObject.vector(ray.direction);
+        scale = dir.norm();
+        return Ray(toObject.point(ray.origin), dir / scale, ray.t);
+    }
+
+    float areaScale; // 世界空间面积与局部空间面积之比
+};
@@ -2,10 +2,14 @@
 #define RAYTRACING_MATERIAL_H
 
 #include "Vector.hpp"
+#include "Sampler.hpp"
 
 // 定义材质类型枚举
 enum MaterialType { DIFFUSE, Microfacet};
 
+// 漫反射材质的半球采样方式：均匀采样 / 余弦加权采样
+enum HemisphereSampling { UNIFORM_HEMISPHERE, COSINE_HEMISPHERE };
+
 
 class Material{
 private:
@@ -33,10 +37,8 @@ private:
         // kt = 1 - kr;
     }
 
-    // 将局部坐标a转换为世界坐标
-    Vector3f toWorld(const Vector3f &a, const Vector3f &N){
-        Vector3f B, C;
-        //将N分解为B和C
+    // 以法线N为z轴构建局部坐标系的另外两个轴B和C
+    void buildFrame(const Vector3f &N, Vector3f &B, Vector3f &C) const {
         //条件判断应该是为了防止除0
         if (std::fabs(N.x) > std::fabs(N.y)){
             float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
@@ -47,8 +49,29 @@ private:
             C = Vector3f(0.0f, N.z * invLen, -N.y *invLen);
         }
         B = crossProduct(C, N);
+    }
+
+    // 将局部坐标a转换为世界坐标
+    Vector3f toWorld(const Vector3f &a, const Vector3f &N){
+        Vector3f B, C;
+        //将N分解为B和C
+        buildFrame(N, B, C);
         return a.x * B + a.y * C + a.z * N;
     }
+
+    // 将世界坐标a转换为以N为z轴的局部坐标（toWorld的逆变换）
+    Vector3f toLocal(const Vector3f &a, const Vector3f &N){
+        Vector3f B, C;
+        buildFrame(N, B, C);
+        return Vector3f(dotProduct(a, B), dotProduct(a, C), dotProduct(a, N));
+    }
+
+    // 余弦加权采样半球（Malley 方法）：在单位圆盘上均匀取点，再投影到半球上，pdf = cos(theta) / PI
+    Vector3f sampleCosineHemisphere(const Vector2f &u, const Vector3f &N){
+        float r = std::sqrt(u.x), phi = 2 * M_PI * u.y;
+        float z = std::sqrt(std::max(0.0f, 1.0f - u.x));
+        return toWorld(Vector3f(r*std::cos(phi), r*std::sin(phi), z), N);
+    }
 private:
     // GGX分布函数
 	float DistributionGGX(Vector3f N, Vector3f H, float roughness)
@@ -88,6 +111,53 @@ private:
 		return ggx1 * ggx2;
 	}
 
+    // GGX 的精确 Smith 遮蔽项 G1，alpha = roughness^2（与 DistributionGGX 一致）
+	float SmithG1GGX(float NdotV, float roughness)
+	{
+		float a2 = roughness * roughness * roughness * roughness;
+		return 2.0f * NdotV / (NdotV + std::sqrt(a2 + (1.0f - a2) * NdotV * NdotV));
+	}
+
+    // 采样 GGX 的可见法线分布（VNDF, Heitz 2018），V 为局部坐标系下的出射方向，返回局部坐标系下的微表面法线
+	Vector3f sampleGGXVNDF(const Vector3f &V, float roughness, const Vector2f &u)
+	{
+		float alpha = roughness * roughness;
+		// 拉伸到 alpha = 1 的半球配置
+		Vector3f Vh = normalize(Vector3f(alpha * V.x, alpha * V.y, V.z));
+		float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+		Vector3f T1 = lensq > 0 ? Vector3f(-Vh.y, Vh.x, 0.0f) / std::sqrt(lensq) : Vector3f(1.0f, 0.0f, 0.0f);
+		Vector3f T2 = crossProduct(Vh, T1);
+		// 在投影后的圆盘上采样
+		float r = std::sqrt(u.x), phi = 2 * M_PI * u.y;
+		float t1 = r * std::cos(phi), t2 = r * std::sin(phi);
+		float s = 0.5f * (1.0f + Vh.z);
+		t2 = (1.0f - s) * std::sqrt(std::max(0.0f, 1.0f - t1 * t1)) + s * t2;
+		Vector3f Nh = t1 * T1 + t2 * T2 + std::sqrt(std::max(0.0f, 1.0f - t1 * t1 - t2 * t2)) * Vh;
+		// 还原拉伸
+		return normalize(Vector3f(alpha * Nh.x, alpha * Nh.y, std::max(0.0f, Nh.z)));
+	}
+
+    // GGX 反射波瓣的 pdf：D_v(H) / (4 V·H) = G1(V) D(H) / (4 N·V)
+	float pdfGGX(const Vector3f &V, const Vector3f &L, const Vector3f &N)
+	{
+		float NdotV = dotProduct(N, V);
+		if (NdotV <= 0.0f)
+			return 0.0f;
+		Vector3f H = normalize(V + L);
+		return SmithG1GGX(NdotV, roughness) * DistributionGGX(N, H, roughness) / (4.0f * NdotV);
+	}
+
+    // 选择镜面波瓣的概率：按菲涅尔项和 Ks / Kd 的亮度加权，限制在 [0.1, 0.9] 内，保证两个波瓣都能采到
+	float specularLobeWeight(const Vector3f &wi, const Vector3f &N) const
+	{
+		float F;
+		fresnel(wi, N, ior, F);
+		auto luminance = [](const Vector3f &c) { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; };
+		float s = F * luminance(Ks), d = (1.0f - F) * luminance(Kd);
+		float w = (s + d > 0.0f) ? s / (s + d) : 0.5f;
+		return clamp(0.1f, 0.9f, w);
+	}
+
 
 public:
     MaterialType m_type; //只有diffuse材质（漫反射材质）
@@ -96,6 +166,8 @@ public:
     float ior;           // 折射率
     Vector3f Kd, Ks;     //Kd漫反射系数，Ks高光镜面反射系数
     float specularExponent; // 高光镜面反射指数
+    float roughness = 0.35f; // Microfacet 材质的粗糙度（GGX 的 alpha = roughness^2）
+    HemisphereSampling diffuseSampling = COSINE_HEMISPHERE; // DIFFUSE 材质的采样方式，保留均匀采样用于对比
     //Texture tex;
 
     inline Material(MaterialType t=DIFFUSE, Vector3f e=Vector3f(0,0,0));
@@ -106,7 +178,7 @@ public:
     inline bool hasEmission();
 
     // sample a ray by Material properties 根据材质属性对入射光线进行采样
-    inline Vector3f sample(const Vector3f &wi, const Vector3f &N);
+    inline Vector3f sample(const Vector3f &wi, const Vector3f &N, Sampler &sampler);
 
     // given a ray, calculate the PdF of this ray 计算采样光线的概率密度函数
     inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
@@ -122,6 +194,7 @@ Material::Material(MaterialType t, Vector3f e){
     m_type = t;
     //m_color = c;
     m_emission = e;
+    ior = 1.85f;
 }
 
 
@@ -133,13 +206,19 @@ bool Material::hasEmission() {
 
 
 
-Vector3f Material::sample(const Vector3f &wi, const Vector3f &N){
+Vector3f Material::sample(const Vector3f &wi, const Vector3f &N, Sampler &sampler){
     switch(m_type){
         case DIFFUSE:
         {
+            Vector2f u = sampler.get2D();
+            // cosine-weighted sample on the hemisphere
+            // 余弦加权采样
+            if (diffuseSampling == COSINE_HEMISPHERE)
+                return sampleCosineHemisphere(u, N);
+
             // uniform sample on the hemisphere
             // 在半球上均匀采样
-            float x_1 = get_random_float(), x_2 = get_random_float();
+            float x_1 = u.x, x_2 = u.y;
             //z∈[0,1]，是随机半球方向的z轴向量
             float z = std::fabs(1.0f - 2.0f * x_1);
             //r是半球半径随机向量以法线为旋转轴的半径
@@ -153,13 +232,17 @@ Vector3f Material::sample(const Vector3f &wi, const Vector3f &N){
         }
 		case Microfacet:
 		{
-			// uniform sample on the hemisphere
-            // 在半球上均匀采样
-			float x_1 = get_random_float(), x_2 = get_random_float();
-			float z = std::fabs(1.0f - 2.0f * x_1);
-			float r = std::sqrt(1.0f - z * z), phi = 2 * M_PI * x_2;
-			Vector3f localRay(r*std::cos(phi), r*std::sin(phi), z);
-			return toWorld(localRay, N);
+			// 先按菲涅尔权重选择镜面波瓣或漫反射波瓣
+			float lobe = sampler.get1D();
+			Vector2f u = sampler.get2D();
+			Vector3f V = -wi;
+			if (lobe < specularLobeWeight(wi, N) && dotProduct(N, V) > 0.0f) {
+				// 镜面波瓣：采样可见微表面法线 H，再把 V 关于 H 反射
+				Vector3f H = toWorld(sampleGGXVNDF(toLocal(V, N), roughness, u), N);
+				return 2.0f * dotProduct(V, H) * H - V;
+			}
+			// 漫反射波瓣：余弦加权采样
+			return sampleCosineHemisphere(u, N);
 
 			break;
 		}
@@ -170,22 +253,27 @@ float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
     switch(m_type){
         case DIFFUSE:
         {
+            float cosTheta = dotProduct(wo, N);
+            if (cosTheta <= 0.0f)
+                return 0.0f;
+            // cosine-weighted sample probability cos(theta) / PI
+            // 余弦加权采样概率为 cos(theta) / PI
+            if (diffuseSampling == COSINE_HEMISPHERE)
+                return cosTheta / M_PI;
             // uniform sample probability 1 / (2 * PI)
             // 均匀采样概率为 1 / (2 * PI)
-            if (dotProduct(wo, N) > 0.0f)
-                return 0.5f / M_PI;
-            else
-                return 0.0f;
+            return 0.5f / M_PI;
             break;
         }
 		case Microfacet:
 		{
-			// uniform sample probability 1 / (2 * PI)
-            // 均匀采样概率为 1 / (2 * PI)
-			if (dotProduct(wo, N) > 0.0f)
-				return 0.5f / M_PI;
-			else
+			// 两个波瓣 pdf 的加权和：w * pdf_GGX + (1 - w) * cos(theta) / PI
+			float cosTheta = dotProduct(wo, N);
+			if (cosTheta <= 0.0f)
 				return 0.0f;
+			Vector3f V = -wi;
+			float w = dotProduct(N, V) > 0.0f ? specularLobeWeight(wi, N) : 0.0f;
+			return w * pdfGGX(V, wo, N) + (1.0f - w) * cosTheta / M_PI;
 			break;
 		}
     }
@@ -218,8 +306,6 @@ Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &
 			// Disney PBR 方案
 			float cosalpha = dotProduct(N, wo);
 			if (cosalpha > 0.0f) {
-				float roughness = 0.35;
-
 				Vector3f V = -wi;
 				Vector3f L = wo;
 				Vector3f H = normalize(V + L);
@@ -234,8 +320,7 @@ Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &
 
 				// 计算 fresnel 系数: F
 				float F;
-				float etat = 1.85;
-				fresnel(wi, N, etat, F);
+				fresnel(wi, N, ior, F);
 
 				Vector3f nominator = D * G * F;
 				float denominator = 4 * std::max(dotProduct(N, V), 0.0f) * std::max(dotProduct(N, L), 0.0f);
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "BVH.hpp"
+#include "ObjReader.hpp"
+
+// 二进制网格缓存：第一次加载 OBJ 时在旁边写出 <obj 路径>.ptmesh，之后直接读取，不再解析文本。
+// 文件布局：文件头 + 顶点位置（float x3）+ 三角形下标（uint32 x3）
+//          + 可选的预构建 BVH（叶子顺序到三角形编号的映射 uint32 + LinearBVHNode 数组）。
+// 文件头记录文件格式版本和 BVH 构建器版本，任何一个与当前程序不同的缓存都整个作废（重新解析 OBJ 并重写缓存）；
+// 还记录源 OBJ 的大小、修改时间和内容校验值：大小和修改时间都相同时直接使用缓存，
+// 只有修改时间变了（例如文件被复制或 touch）时才重新计算 OBJ 的校验值比较，内容不同则缓存失效。
+// BVH 部分只在构建选项（划分方法、叶子最大物体数）相同时使用，否则只复用网格并重新构建 BVH
+class MeshCache
+{
+public:
+    static std::string cachePath(const std::string& objPath) { return objPath + ".ptmesh"; }
+
+    // 读取 objPath 对应的缓存。返回 false 表示缓存不存在或已失效；
+    // 返回 true 时 mesh 和 sourceChecksum 有效，BVH 可用时 primOrder、nodes 非空
+    static bool load(const std::string& objPath, BVHAccel::SplitMethod splitMethod, int maxPrimsInNode,
+                     ObjMesh& mesh, uint64_t& sourceChecksum,
+                     std::vector<uint32_t>& primOrder, std::vector<LinearBVHNode>& nodes)
+    {
+        std::vector<char> data;
+        if (!ObjReader::readFile(cachePath(objPath), data) || data.size() < sizeof(Header))
+            return false;
+        Header header, expected;
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, expected.magic, sizeof(header.magic)) || header.version != expected.version
+            || header.builderVersion != expected.builderVersion)
+            return false;
+
+        // 各段大小必须与文件长度一致
+        size_t numTriangles = header.numIndices / 3;
+        size_t positionsBytes = (size_t)header.numPositions * sizeof(Vector3f);
+        size_t indicesBytes = (size_t)header.numIndices * sizeof(uint32_t);
+        size_t orderBytes = header.numNodes ? numTriangles * sizeof(uint32_t) : 0;
+        size_t nodesBytes = (size_t)header.numNodes * sizeof(LinearBVHNode);
+        if (header.numIndices % 3 || data.size() != sizeof(Header) + positionsBytes + indicesBytes + orderBytes + nodesBytes)
+            return false;
+
+        // 源文件是否变化
+        uint64_t size;
+        int64_t time;
+        if (!sourceStamp(objPath, size, time) || size != header.sourceSize)
+            return false;
+        if (time != header.sourceTime) {
+            std::vector<char> source;
+            if (!ObjReader::readFile(objPath, source) || ObjReader::fileChecksum(source.data(), source.size()) != header.sourceChecksum)
+                return false;
+            // 内容没变：更新缓存中记录的修改时间，下次不必再计算校验值
+            header.sourceTime = time;
+            if (FILE* fp = fopen(cachePath(objPath).c_str(), "r+b")) {
+                fwrite(&header, sizeof(header), 1, fp);
+                fclose(fp);
+            }
+        }
+
+        const char* p = data.data() + sizeof(Header);
+        mesh.positions.resize(header.numPositions);
+        memcpy(mesh.positions.data(), p, positionsBytes);
+        p += positionsBytes;
+        mesh.indices.resize(header.numIndices);
+        memcpy(mesh.indices.data(), p, indicesBytes);
+        p += indicesBytes;
+        for (uint32_t index : mesh.indices)
+            if (index >= header.numPositions)
+                return false;
+        sourceChecksum = header.sourceChecksum;
+
+        primOrder.clear();
+        nodes.clear();
+        if (header.numNodes && header.splitMethod == (int32_t)splitMethod && header.maxPrimsInNode == maxPrimsInNode) {
+            primOrder.resize(numTriangles);
+            memcpy(primOrder.data(), p, orderBytes);
+            p += orderBytes;
+            nodes.resize(header.numNodes);
+            memcpy(nodes.data(), p, nodesBytes);
+            if (!validBVH(primOrder, nodes)) {
+                primOrder.clear();
+                nodes.clear();
+            }
+        }
+        return true;
+    }
+
+    // 写出缓存；primOrder / nodes 为空时只保存网格。先写临时文件再替换（replaceFile，已存在的旧缓存会被覆盖），并发运行的其他进程不会读到写了一半的缓存
+    static bool save(const std::string& objPath, BVHAccel::SplitMethod splitMethod, int maxPrimsInNode,
+                     const ObjMesh& mesh, uint64_t sourceChecksum,
+                     const std::vector<uint32_t>& primOrder, const std::vector<LinearBVHNode>& nodes)
+    {
+        Header header;
+        if (!sourceStamp(objPath, header.sourceSize, header.sourceTime))
+            return false;
+        header.sourceChecksum = sourceChecksum;
+        header.numPositions = (uint32_t)mesh.positions.size();
+        header.numIndices = (uint32_t)mesh.indices.size();
+        bool withBVH = !nodes.empty() && primOrder.size() == mesh.indices.size() / 3;
+        header.numNodes = withBVH ? (uint32_t)nodes.size() : 0;
+        header.splitMethod = (int32_t)splitMethod;
+        header.maxPrimsInNode = maxPrimsInNode;
+
+        std::string path = cachePath(objPath), tmp = path + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "wb");
+        if (!fp)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+               && fwrite(mesh.positions.data(), sizeof(Vector3f), mesh.positions.size(), fp) == mesh.positions.size()
+               && fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), fp) == mesh.indices.size();
+        if (ok && withBVH)
+            ok = fwrite(primOrder.data(), sizeof(uint32_t), primOrder.size(), fp) == primOrder.size()
+              && fwrite(nodes.data(), sizeof(LinearBVHNode), nodes.size(), fp) == nodes.size();
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return replaceFile(tmp, path);
+    }
+
+private:
+    static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f must be tightly packed");
+
+    struct Header
+    {
+        char magic[4] = {'P', 'T', 'M', 'S'};
+        uint32_t version = 2;        // 文件格式（含校验值算法）的版本，修改格式时加一
+        uint64_t sourceSize = 0;     // 源 OBJ 的字节数
+        int64_t sourceTime = 0;      // 源 OBJ 的修改时间
+        uint64_t sourceChecksum = 0; // 源 OBJ 内容的校验值（ObjReader::fileChecksum）
+        uint32_t numPositions = 0;
+        uint32_t numIndices = 0;
+        uint32_t numNodes = 0;       // 0 表示没有保存 BVH
+        int32_t splitMethod = 0;     // 保存的 BVH 的构建选项
+        int32_t maxPrimsInNode = 0;
+        uint32_t builderVersion = BVHAccel::builderVersion; // 写出缓存的 BVH 构建器版本
+    };
+    static_assert(sizeof(Header) == 56, "unexpected mesh cache header size");
+
+    static bool sourceStamp(const std::string& objPath, uint64_t& size, int64_t& time)
+    {
+        std::error_code ec;
+        size = std::filesystem::file_size(objPath, ec);
+        if (ec)
+            return false;
+        time = (int64_t)std::filesystem::last_write_time(objPath, ec).time_since_epoch().count();
+        return !ec;
+    }
+
+    // 检查读入的 BVH 的下标都在范围内，防止损坏的缓存导致越界访问
+    static bool validBVH(const std::vector<uint32_t>& primOrder, const std::vector<LinearBVHNode>& nodes)
+    {
+        for (uint32_t t : primOrder)
+            if (t >= primOrder.size())
+                return false;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const LinearBVHNode& node = nodes[i];
+            if (node.nPrimitives > 0) {
+                if (node.primitivesOffset < 0 || (size_t)node.primitivesOffset + node.nPrimitives > primOrder.size())
+                    return false;
+            } else if (node.secondChildOffset <= (int)i + 1 || (size_t)node.secondChildOffset >= nodes.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
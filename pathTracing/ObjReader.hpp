@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Vector.hpp"
+#include "global.hpp"
+
+// 从 OBJ 文件读出的三角形网格：顶点位置和每个三角形三个顶点的下标（从 0 开始）
+struct ObjMesh
+{
+    std::vector<Vector3f> positions;
+    std::vector<uint32_t> indices;
+};
+
+// OBJ 读取器：只解析渲染需要的 v（顶点位置）和 f（面）两种语句，其余语句（vt、vn、g、o、usemtl 等）跳过。
+// 整个文件一次读入内存，逐行用 std::from_chars 原地解析数字，不为每行分配字符串、不拆分 token，
+// 结果直接写入扁平的顶点和下标数组。多边形面按扇形拆成三角形。
+// 文件较大时按行边界切成若干块，由多个线程并行解析后再按顺序拼接，结果与单线程解析完全相同
+class ObjReader
+{
+public:
+    // 读取 path 到 mesh，numThreads <= 0 时使用全部硬件线程；文件无法打开或格式错误时返回 false。
+    // checksum 不为空时同时返回文件内容的校验值（见 fileChecksum，网格缓存用它判断 OBJ 是否被修改）
+    static bool read(const std::string& path, ObjMesh& mesh, int numThreads = 0, uint64_t* checksum = nullptr)
+    {
+        std::vector<char> data;
+        if (!readFile(path, data))
+            return false;
+        if (numThreads <= 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (checksum)
+            *checksum = fileChecksum(data.data(), data.size(), numThreads);
+        const char* begin = data.data();
+        const char* end = begin + data.size();
+
+        // 小文件不值得开线程
+        const size_t minChunkBytes = 1 << 20;
+        size_t numChunks = std::max<size_t>(1, std::min<size_t>(numThreads, data.size() / minChunkBytes));
+
+        // 按行边界切块
+        std::vector<const char*> bounds{ begin };
+        for (size_t c = 1; c < numChunks; ++c) {
+            const char* p = std::max(bounds.back(), begin + data.size() * c / numChunks);
+            const char* nl = (const char*)memchr(p, '\n', end - p);
+            bounds.push_back(nl ? nl + 1 : end);
+        }
+        bounds.push_back(end);
+
+        std::vector<Chunk> chunks(numChunks);
+        std::vector<char> ok(numChunks, 0);
+        if (numChunks == 1) {
+            ok[0] = parse(begin, end, chunks[0]);
+        } else {
+            std::vector<std::thread> threads;
+            for (size_t c = 0; c < numChunks; ++c)
+                threads.emplace_back([&, c]() { ok[c] = parse(bounds[c], bounds[c + 1], chunks[c]); });
+            for (auto& t : threads)
+                t.join();
+        }
+        for (char chunkOk : ok)
+            if (!chunkOk)
+                return false;
+
+        // 负下标（相对于当前已出现的顶点数）在块内按块内顶点数解析，这里加上之前各块的顶点数
+        uint32_t vertexOffset = 0;
+        for (Chunk& chunk : chunks) {
+            for (size_t k : chunk.relative)
+                chunk.mesh.indices[k] += vertexOffset;
+            vertexOffset += (uint32_t)chunk.mesh.positions.size();
+        }
+
+        if (numChunks == 1) {
+            mesh = std::move(chunks[0].mesh);
+        } else {
+            size_t numPositions = 0, numIndices = 0;
+            for (const Chunk& chunk : chunks) {
+                numPositions += chunk.mesh.positions.size();
+                numIndices += chunk.mesh.indices.size();
+            }
+            mesh.positions.clear();
+            mesh.indices.clear();
+            mesh.positions.reserve(numPositions);
+            mesh.indices.reserve(numIndices);
+            for (const Chunk& chunk : chunks) {
+                mesh.positions.insert(mesh.positions.end(), chunk.mesh.positions.begin(), chunk.mesh.positions.end());
+                mesh.indices.insert(mesh.indices.end(), chunk.mesh.indices.begin(), chunk.mesh.indices.end());
+            }
+        }
+
+        for (uint32_t index : mesh.indices)
+            if (index >= mesh.positions.size())
+                return false;
+        return true;
+    }
+
+    // 文件内容的校验值：按固定大小（与线程数无关，结果确定）分块，各块由多个线程并行地每次读 8 字节计算哈希，
+    // 再按顺序把各块的哈希合并起来。numThreads <= 0 时使用全部硬件线程
+    static uint64_t fileChecksum(const void* data, size_t size, int numThreads = 0)
+    {
+        const size_t blockBytes = 1 << 20;
+        const char* bytes = static_cast<const char*>(data);
+        size_t numBlocks = std::max<size_t>(1, (size + blockBytes - 1) / blockBytes);
+        std::vector<uint64_t> blockHash(numBlocks);
+        auto hashBlocks = [&](size_t first, size_t last) {
+            for (size_t b = first; b < last; ++b) {
+                size_t offset = b * blockBytes;
+                blockHash[b] = hashWords(bytes + offset, std::min(blockBytes, size - offset));
+            }
+        };
+
+        if (numThreads <= 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        size_t numWorkers = std::min<size_t>(numThreads, numBlocks);
+        if (numWorkers == 1) {
+            hashBlocks(0, numBlocks);
+        } else {
+            std::vector<std::thread> threads;
+            for (size_t w = 0; w < numWorkers; ++w)
+                threads.emplace_back(hashBlocks, numBlocks * w / numWorkers, numBlocks * (w + 1) / numWorkers);
+            for (auto& t : threads)
+                t.join();
+        }
+
+        uint64_t h = hashValue(0xcbf29ce484222325ULL, (uint64_t)size);
+        for (uint64_t blockHashValue : blockHash)
+            h = hashValue(h, blockHashValue);
+        return h;
+    }
+
+    // 把整个文件一次读入 data
+    static bool readFile(const std::string& path, std::vector<char>& data)
+    {
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp)
+            return false;
+        bool ok = fseek(fp, 0, SEEK_END) == 0;
+        long size = ok ? ftell(fp) : -1;
+        ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+        if (ok) {
+            data.resize((size_t)size);
+            ok = fread(data.data(), 1, data.size(), fp) == data.size();
+        }
+        fclose(fp);
+        return ok;
+    }
+
+private:
+    // 一个块的解析结果；relative 记录 indices 中由负下标得到、还需要加上前面各块顶点数的位置
+    struct Chunk
+    {
+        ObjMesh mesh;
+        std::vector<size_t> relative;
+    };
+
+    // 一块数据的哈希：FNV-1a 的每字节一步改为每 8 字节一步；乘法只把低位扩散到高位，每步再把高位异或回低位。
+    // 末尾不足 8 字节的部分逐字节处理
+    static uint64_t hashWords(const char* p, size_t size)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        size_t numWords = size / sizeof(uint64_t);
+        for (size_t i = 0; i < numWords; ++i) {
+            uint64_t word;
+            memcpy(&word, p + i * sizeof(uint64_t), sizeof(word));
+            h = (h ^ word) * 0x100000001b3ULL;
+            h ^= h >> 32;
+        }
+        return hashBytes(h, p + numWords * sizeof(uint64_t), size - numWords * sizeof(uint64_t));
+    }
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    static bool parseFloat(const char*& p, const char* end, float& value)
+    {
+        p = skipSpace(p, end);
+        if (p < end && *p == '+') // from_chars 不接受正号
+            ++p;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc())
+            return false;
+        p = result.ptr;
+        return true;
+    }
+
+    // 解析 [begin, end) 中的所有行
+    static bool parse(const char* begin, const char* end, Chunk& chunk)
+    {
+        ObjMesh& mesh = chunk.mesh;
+        // 按字节数粗略预留空间，减少扩容次数
+        mesh.positions.reserve((end - begin) / 64);
+        mesh.indices.reserve((end - begin) / 16);
+
+        for (const char* p = begin; p < end;) {
+            const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+            if (!lineEnd)
+                lineEnd = end;
+            p = skipSpace(p, lineEnd);
+
+            if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1])) {
+                Vector3f v;
+                p += 1;
+                if (!parseFloat(p, lineEnd, v.x) || !parseFloat(p, lineEnd, v.y) || !parseFloat(p, lineEnd, v.z))
+                    return false;
+                mesh.positions.push_back(v);
+            } else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1])) {
+                // 面的每个顶点形如 v、v/vt、v//vn 或 v/vt/vn，只取位置下标
+                uint32_t first = 0, previous = 0;
+                bool relativeFirst = false, relativePrevious = false;
+                int numVertices = 0;
+                p += 1;
+                for (;;) {
+                    p = skipSpace(p, lineEnd);
+                    if (p == lineEnd || *p == '#')
+                        break;
+                    int64_t index;
+                    auto result = std::from_chars(p, lineEnd, index);
+                    if (result.ec != std::errc() || index == 0)
+                        return false;
+                    p = result.ptr;
+                    while (p < lineEnd && !isSpace(*p))
+                        ++p;
+
+                    uint32_t current;
+                    bool relative = index < 0;
+                    if (relative) // 负下标相对于块内已读的顶点数，拼接时再加上块的起始偏移（无符号回绕保证结果正确）
+                        current = (uint32_t)((int64_t)mesh.positions.size() + index);
+                    else
+                        current = (uint32_t)(index - 1);
+
+                    if (numVertices >= 2) {
+                        // 扇形三角化：(first, previous, current)
+                        size_t k = mesh.indices.size();
+                        mesh.indices.push_back(first);
+                        mesh.indices.push_back(previous);
+                        mesh.indices.push_back(current);
+                        if (relativeFirst) chunk.relative.push_back(k);
+                        if (relativePrevious) chunk.relative.push_back(k + 1);
+                        if (relative) chunk.relative.push_back(k + 2);
+                    }
+                    if (numVertices == 0) {
+                        first = current;
+                        relativeFirst = relative;
+                    }
+                    previous = current;
+                    relativePrevious = relative;
+                    ++numVertices;
+                }
+            }
+            p = lineEnd + 1;
+        }
+        return true;
+    }
+};
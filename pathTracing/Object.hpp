@@ -19,6 +19,12 @@ public:
     virtual bool intersect(const Ray& ray, float &, uint32_t &) const = 0;
     // ȡĽϢ
     virtual Intersection getIntersection(Ray _ray) = 0;
+    // ж [0, tMax) ΧǷڵӰãҪ콻Ϣ
+    virtual bool intersectP(const Ray& ray, float tMax)
+    {
+        Intersection inter = getIntersection(ray);
+        return inter.happened && inter.distance < tMax;
+    }
     // ȡ㴦ԣ編
     virtual void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &, Vector3f &, Vector2f &) const = 0;
     // ȡĳɫ
@@ -28,9 +34,17 @@ public:
     // ȡı
     virtual float getArea()=0;
     // һ㣬ܶȺֵ
-    virtual void Sample(Intersection &pos, float &pdf)=0;
+    virtual void Sample(Intersection &pos, float &pdf, Sampler &sampler)=0;
     // жǷǹԴǷ
     virtual bool hasEmit()=0;
+    // Ĳʣڼ㳡ϣ
+    virtual Material* getMaterial()=0;
+    // пԵķ outĬݴ˽Դֲ
+    virtual void collectEmitters(std::vector<Object*> &out)
+    {
+        if (hasEmit())
+            out.push_back(this);
+    }
 };
 
 
@@ -1,5 +1,7 @@
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 
 // 互斥锁，用于线程同步
 std::mutex mutex_ins;
@@ -8,94 +10,273 @@ std::mutex mutex_ins;
 #include <fstream>
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "Film.hpp"
+#include "Filter.hpp"
+#include "TileScheduler.hpp"
+#include "WavefrontIntegrator.hpp"
 
 
-// 将角度转换为弧度的辅助函数
-inline float deg2rad(const float& deg) { return deg * M_PI / 180.0; }
-
 // 定义一个很小的常量
 const float EPSILON = 0.00001;
 
+// 自适应采样：汇总像素误差的窗口半径（1 即 3x3 窗口），以及相对误差分母上加的常数
+// （线性辐射度，约为显示亮度的一半，暗处的噪声在 gamma 映射后不如亮处明显，不必采到同样的相对误差）
+const int ADAPTIVE_RADIUS = 1;
+const double ADAPTIVE_DELTA = 0.3;
+
 // 渲染函数，主要实现光线追踪算法，渲染场景并保存结果
-void Renderer::Render(const Scene& scene)
+bool Renderer::Render(const Scene& scene, const Camera& camera)
 {
-	// 创建一个存储像素颜色的缓冲区
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+	int width = camera.width, height = camera.height;
+
+	// 累积缓冲区：每个像素的辐射度累加和与采样数
+    Film film(width, height);
+
+	// 抖动采样：每个采样在像素内按重建滤波器的分布随机偏移（抗锯齿）。
+	// 关闭抖动且为针孔相机时所有采样共用穿过像素中心的主光线，每个像素只求交一次
+	PixelFilter pixelFilter(filter, filterRadius);
+	bool cacheFirstHit = !jitter && !camera.hasLens();
+
+	// 像素 (i, j) 的一次采样的主光线：依次用掉像素内抖动（开启时）和透镜（薄透镜相机）两个二维样本
+	auto primaryRay = [&](int i, int j, Sampler& sampler) {
+		Vector2f offset = jitter ? pixelFilter.sample(sampler.get2D()) : Vector2f(0, 0);
+		if (!camera.hasLens())
+			return camera.generateRay(i + 0.5f + offset.x, j + 0.5f + offset.y);
+		return camera.generateRay(i + 0.5f + offset.x, j + 0.5f + offset.y, sampler.get2D());
+	};
 
-	// 计算摄像机参数
-    float scale = tan(deg2rad(scene.fov * 0.5));
-    float imageAspectRatio = scene.width / (float)scene.height;
-    Vector3f eye_pos(278, 273, -800); // 摄像机位置
-    int m = 0;  // 用于记录当前像素的索引
+	// 射线数量：每个像素点的采样数量（光线追踪次数）；渐进式渲染时每一遍只追加 passSpp 个采样
+	// 自适应采样需要分多遍渲染，未指定每遍采样数时以 adaptiveMinSpp 为一遍
+	bool adaptive = adaptiveThreshold > 0;
+	int passSpp = this->passSpp > 0 ? this->passSpp : (adaptive ? adaptiveMinSpp : spp);
+	passSpp = std::max(1, std::min(passSpp, spp));
+	std::cout << "SPP: " << spp << " (" << passSpp << " per pass)\n";
+	if (adaptive)
+		std::cout << "Adaptive sampling: relative error < " << adaptiveThreshold << " over "
+			<< 2 * ADAPTIVE_RADIUS + 1 << "x" << 2 * ADAPTIVE_RADIUS + 1 << " pixels after " << adaptiveMinSpp << " spp\n";
 
-	// 射线数量：设置每个像素点的采样数量（光线追踪次数）
-	int spp = 100; // 每个像素只进行一次采样（无抗锯齿）
-	std::cout << "SPP: " << spp << "\n";
+	// 检查点：从上次中断处继续采样。每个像素从自己已完成的采样数接着往下采，
+	// 采样器仍按（像素编号，采样编号）播种，所以恢复后的结果与不中断的渲染逐位相同
+	uint64_t seed = this->seed;
+	uint64_t sceneHash = hashValue(scene.hash(), samplerType);
+	sceneHash = hashValue(hashValue(hashValue(sceneHash, jitter), filter), pixelFilter.getRadius());
+	sceneHash = hashValue(hashValue(hashValue(sceneHash, camera.position), camera.forward), camera.up);
+	sceneHash = hashValue(hashValue(hashValue(sceneHash, camera.fov), camera.aperture), camera.focusDistance);
+	if (resume && !checkpoint.empty() && std::ifstream(checkpoint).good()) {
+		uint64_t fileHash = 0;
+		if (!film.readCheckpoint(checkpoint, seed, fileHash)) {
+			std::cerr << "Cannot read checkpoint " << checkpoint << " (corrupt or different resolution)\n";
+			return false;
+		}
+		if (fileHash != sceneHash) {
+			std::cerr << "Checkpoint " << checkpoint << " was written for a different scene\n";
+			return false;
+		}
+		// 继续采样必须沿用检查点的种子，命令行给出的种子与之不同时提示用户
+		if (seed != this->seed)
+			std::cerr << "Warning: checkpoint " << checkpoint << " was rendered with seed " << seed
+			          << ", continuing with it instead of seed " << this->seed << "\n";
+		std::cout << "Resuming from " << checkpoint << " at " << film.minCount() << " spp\n";
+	}
 
-	int process = 0; // 用于记录渲染进度
+	std::atomic<long long> process(0); // 用于记录渲染进度（已完成的像素采样数）
+	for (uint32_t c : film.count)
+		process += std::min<long long>(c, spp);
 
-	// 创造匿名函数，为不同线程划分不同块
-	auto castRayMultiThreading = [&](uint32_t rowStart, uint32_t rowEnd, uint32_t colStart, uint32_t colEnd)
+	// 像素 m 在本遍（采到 passEnd 个采样为止）是否还需要采样：采样数不足，且（自适应采样时）尚未收敛
+	auto needsSamples = [&](int m, int passEnd) {
+		return (int)film.count[m] < passEnd && (!adaptive || !film.converged[m]);
+	};
+
+	// 自适应采样：每一遍开始前，对采样数恰好等于本遍起点 done 且尚未判断过的像素判断一次收敛。
+	// 判断在渲染之前单线程完成，窗口内的邻居像素不会被其他线程同时修改；各遍的边界固定在 passSpp 的整数倍上，
+	// 每个像素只在自己的采样数与遍的起点相同时判断，且判断过的采样数记录在检查点中，
+	// 因此收敛结果与线程数、时间预算中断和检查点恢复无关。像素一旦收敛就不再采样
+	auto updateConvergence = [&](int done) {
+		for (int j = 0; j < height; ++j) {
+			for (int i = 0; i < width; ++i) {
+				int m = j * width + i;
+				if (film.converged[m] || (int)film.count[m] != done || film.checkedAt[m] == (uint32_t)done || done < adaptiveMinSpp)
+					continue;
+				film.checkedAt[m] = done;
+				film.converged[m] = film.relativeError(i, j, ADAPTIVE_RADIUS, ADAPTIVE_DELTA) < adaptiveThreshold;
+			}
+		}
+	};
+
+	// 分块内是否有像素需要采样
+	auto tileActive = [&](const Tile& tile, int passEnd) {
+		for (int j = tile.y0; j < tile.y1; ++j)
+			for (int i = tile.x0; i < tile.x1; ++i)
+				if (needsSamples(j * width + i, passEnd))
+					return true;
+		return false;
+	};
+
+	// 渲染一个分块内所有需要采样的像素，直到它们都有 passEnd 个采样，返回新增的采样数
+	auto renderTile = [&](const Tile& tile, int passEnd, Sampler& sampler)
 	{
-		for (uint32_t j = rowStart; j < rowEnd; ++j) {
-			int m = j * scene.width + colStart;
-			for (uint32_t i = colStart; i < colEnd; ++i) {
-				// generate primary ray direction 生成主光线方向
-				float x = (2 * (i + 0.5) / (float)scene.width - 1) * imageAspectRatio * scale;
-				float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-				Vector3f dir = normalize(Vector3f(-x, y, 1)); // 计算光线方向
-
-				for (int k = 0; k < spp; k++) {
-					// 对场景中的每一个像素进行光线追踪，生成颜色并累加到framebuffer中（路径追踪）
-					framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;//光线追踪
+		long long added = 0;
+		for (int j = tile.y0; j < tile.y1; ++j) {
+			int m = j * width + tile.x0;
+			for (int i = tile.x0; i < tile.x1; ++i, ++m) {
+				if (!needsSamples(m, passEnd))
+					continue;
+				// generate primary ray direction 生成主光线方向；不抖动时主光线的交点在所有采样间共用
+				Ray centerRay = camera.generateRay(i + 0.5f, j + 0.5f);
+				Intersection firstHit;
+				if (cacheFirstHit)
+					firstHit = scene.intersect(centerRay);
+
+				for (int k = film.count[m]; k < passEnd; k++) {
+					// 按（像素编号，采样编号）为采样器播种，渲染结果与线程数、分块大小、每遍采样数无关
+					sampler.startPixelSample(m, k);
+					// 对场景中的每一个像素进行光线追踪，生成颜色并累加到累积缓冲区中（路径追踪）
+					if (!cacheFirstHit)
+						film.addSample(m, scene.castRay(primaryRay(i, j, sampler), 0, sampler));//光线追踪
+					else
+						film.addSample(m, scene.shade(centerRay, firstHit, 0, sampler));
+					added++;
 				}
-				m++;
-				process++;
 			}
+		}
+		return added;
+	};
 
-			// 互斥锁，用于打印处理进程
-			std::lock_guard<std::mutex> g1(mutex_ins);
-			UpdateProgress(1.0*process / scene.width / scene.height);
+	// 波前模式：先生成分块内所有像素的所有主光线，再交给积分器整批追踪
+	auto renderTileWavefront = [&](const Tile& tile, int passEnd, WavefrontIntegrator& integrator)
+	{
+		std::vector<Ray> rays;
+		std::vector<Sampler> samplers;
+		std::vector<uint32_t> pixelIndex;
+		std::vector<Intersection> primaryHits;
+		std::vector<Vector3f> radiance;
+		for (int j = tile.y0; j < tile.y1; ++j) {
+			for (int i = tile.x0; i < tile.x1; ++i) {
+				int m = j * width + i;
+				if (!needsSamples(m, passEnd))
+					continue;
+				Ray centerRay = camera.generateRay(i + 0.5f, j + 0.5f);
+				Intersection firstHit;
+				if (cacheFirstHit)
+					firstHit = scene.intersect(centerRay);
+				for (int k = film.count[m]; k < passEnd; k++) {
+					samplers.emplace_back(seed, samplerType);
+					samplers.back().startPixelSample(m, k);
+					if (!cacheFirstHit) {
+						rays.push_back(primaryRay(i, j, samplers.back()));
+					} else {
+						rays.push_back(centerRay);
+						primaryHits.push_back(firstHit);
+					}
+					pixelIndex.push_back(m);
+				}
+			}
 		}
+		integrator.trace(rays, samplers, radiance, cacheFirstHit ? &primaryHits : nullptr);
+		// 按与 castRay 模式相同的顺序累加
+		for (size_t k = 0; k < rays.size(); ++k)
+			film.addSample(pixelIndex[k], radiance[k]);
+		return (long long)rays.size();
 	};
 
-	// 分块计算光线追踪
-	int id = 0;
-	constexpr int bx = 5; // x方向分块数
-	constexpr int by = 5; // y方向分块数
-	std::thread th[bx * by];
+	// 更新进度条
+	auto finishTile = [&](long long added)
+	{
+		process += added;
+
+		// 互斥锁，用于打印处理进程
+		std::lock_guard<std::mutex> g1(mutex_ins);
+		UpdateProgress(1.0 * process / width / height / spp);
+	};
+
+	// 时间预算：超时后不再分配新的分块，已领取的分块仍会完成。
+	// 每个像素记录了自己的采样数，所以中途停止时各像素采样数不同也不影响结果的正确性
+	auto startTime = std::chrono::steady_clock::now();
+	auto elapsed = [&]() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	};
+	std::atomic<bool> outOfTime(false);
 
-	int strideX = (scene.width + 1) / bx;  // x方向每块的像素数
-	int strideY = (scene.height + 1) / by;  // y方向每块的像素数
+	// 线程池：线程数默认等于硬件线程数，每个线程不断从调度器领取分块，
+	// 自己的分块做完后会从其他线程那里窃取，直到所有分块完成
+	int workers = numThreads > 0 ? numThreads : (int)std::thread::hardware_concurrency();
+	if (workers <= 0) workers = 1;
+	prepareWorkers(scene, workers);
+	std::cout << "Tiles: " << TileScheduler(width, height, tileSize, workers).numTiles()
+		<< " (" << tileSize << "x" << tileSize << "), threads: " << workers << "\n";
 
-	// 分块计算光线追踪
-	for (int i = 0; i < scene.height; i += strideX)
+	// 每一遍对整幅图像追加 passSpp 个采样，直到达到 spp 或用完时间预算。
+	// 自适应采样时每一遍只调度还有未收敛像素的分块，工作窃取在剩下的分块之间重新平衡负载
+	double lastPreview = 0, lastCheckpoint = 0;
+	for (int done = (int)film.minCount(); done < spp && !outOfTime; )
 	{
-		for (int j = 0; j < scene.width; j += strideY)
-		{
-			// 将不同块的光线追踪任务分配给不同的线程
-			th[id] = std::thread(castRayMultiThreading, i, std::min(i + strideX, scene.height), j, std::min(j + strideY, scene.width));
-			id++;
+		if (adaptive)
+			updateConvergence(done);
+		int passEnd = std::min((done / passSpp + 1) * passSpp, spp);
+		TileScheduler scheduler(width, height, tileSize, workers,
+			[&](const Tile& tile) { return tileActive(tile, passEnd); });
+		done = passEnd;
+		if (scheduler.numTiles() == 0)
+			continue;
+
+		// 所有线程执行完本遍的分块后 run 才返回
+		pool->run([&](int w) {
+			Sampler sampler(seed, samplerType); // 每个线程一个采样器
+			WavefrontIntegrator& integrator = *integrators[w]; // 每个线程一组路径队列，在分块、各遍和各帧之间复用
+			Tile tile;
+			while (!outOfTime && scheduler.next(w, tile)) {
+				if (timeBudget > 0 && elapsed() >= timeBudget) {
+					outOfTime = true;
+					break;
+				}
+				if (wavefront)
+					finishTile(renderTileWavefront(tile, passEnd, integrator));
+				else
+					finishTile(renderTile(tile, passEnd, sampler));
+			}
+		});
+
+		// 定期写出预览图和检查点
+		if (done < spp && !outOfTime && elapsed() - lastPreview >= previewInterval) {
+			if (!film.writePPM(output))
+				std::cerr << "Cannot write preview image " << output << "\n";
+			lastPreview = elapsed();
+		}
+		if (done < spp && !outOfTime && !checkpoint.empty() && elapsed() - lastCheckpoint >= checkpointInterval) {
+			if (!film.writeCheckpoint(checkpoint, seed, sceneHash))
+				std::cerr << "Cannot write checkpoint " << checkpoint << "\n";
+			lastCheckpoint = elapsed();
 		}
 	}
 
-	// 等待所有线程执行完毕
-	for (int i = 0; i < bx*by; i++) th[i].join();
-
 	//进度条
 	UpdateProgress(1.f);
+	long long totalSamples = 0;
+	for (uint32_t c : film.count)
+		totalSamples += c;
+	if (outOfTime)
+		std::cout << "\nTime budget of " << timeBudget << " s reached";
+	if (outOfTime || adaptive)
+		std::cout << "\nAverage spp: " << (double)totalSamples / ((long long)width * height) << "\n";
 
+	// 将渲染结果保存到文件中；检查点也写出最终状态，之后可以用更大的 spp 继续渲染
+	bool written = film.writePPM(output);
+	if (!written)
+		std::cerr << "Cannot write image " << output << "\n";
+	if (!checkpoint.empty() && !film.writeCheckpoint(checkpoint, seed, sceneHash))
+		std::cerr << "Cannot write checkpoint " << checkpoint << "\n";
+	return written;
+}
 
-	// 将渲染结果保存到文件中
-    FILE* fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-		// 将颜色进行gamma校正，然后映射到0-255的范围，并保存到文件中
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+void Renderer::prepareWorkers(const Scene& scene, int workers)
+{
+	if (!pool || pool->size() != workers)
+		pool.reset(new WorkerPool(workers));
+	if ((int)integrators.size() != workers || integratorScene != &scene) {
+		integrators.clear();
+		for (int w = 0; w < workers; ++w)
+			integrators.emplace_back(new WavefrontIntegrator(scene));
+		integratorScene = &scene;
+	}
 }
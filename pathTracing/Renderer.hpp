@@ -1,5 +1,12 @@
 
+#include <memory>
+#include <string>
+#include <vector>
 #include "Scene.hpp"
+#include "WavefrontIntegrator.hpp"
+#include "WorkerPool.hpp"
+#include "Filter.hpp"
+#include "Camera.hpp"
 
 #pragma once
 
@@ -15,7 +22,35 @@ struct hit_payload
 class Renderer
 {
 public:
-    void Render(const Scene& scene);
+    int tileSize = 32;  // ֿ߳أ
+    int numThreads = 0; // ߳0 ʾʹ std::thread::hardware_concurrency()
+    bool wavefront = false; // ʹòǰWavefrontIntegratorݹ Scene::castRay
+
+    int spp = 100;          // ÿصĿ
+    int passSpp = 0;        // ʽȾÿһ׷ӵĲ0 ʾһȾȫ spp
+    double timeBudget = 0;  // ȾʱԤ㣨룩ֹͣµķֿ飬0 ʾʱ
+    double previewInterval = 30; // ʽȾʱдԤͼ̼֮룩
+    std::string output = "binary.ppm"; // ͼ·ԤͼҲд
+    uint64_t seed = 0;      // 
+    SamplerType samplerType = SOBOL_SAMPLER; // ͣڶԱ
+    bool jitter = true;     // ڶߣݣرʱÿֻһ
+    FilterType filter = BOX_FILTER; // ؽ˲ƫƵķֲ
+    float filterRadius = 0; // ˲뾶أ0 ʾʹø˲Ĭϰ뾶
+    std::string checkpoint; // ļ·Ϊʱд
+    double checkpointInterval = 300; // д̼֮룩
+    bool resume = false;    // ӼļȾļʱͷʼ
+    double adaptiveThreshold = 0; // ӦΧڵڸֵʱֹͣ0 ʾر
+    int adaptiveMinSpp = 16;      // ӦжǰÿٵĲ
+
+    // Ⱦдͼ񣻼뵱ǰƥͼдʧʱ false
+    // ͬһ Renderer Ⱦӽʱ̺߳ÿ̵߳Ĳǰڸ֮֡临
+    bool Render(const Scene& scene, const Camera& camera);
 
 private:
+    // 贴߳򳡾仯ʱؽ̳߳غÿ̵߳Ĳǰ
+    void prepareWorkers(const Scene& scene, int workers);
+
+    std::unique_ptr<WorkerPool> pool;
+    std::vector<std::unique_ptr<WavefrontIntegrator> > integrators; // ÿ߳һ
+    const Scene* integratorScene = nullptr; // integrators Ӧĳ
 };
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include "Vector.hpp"
+
+// PCG32 随机数发生器（O'Neill, pcg-random.org），状态只有 16 字节，
+// 构造和生成都远比 std::random_device + std::mt19937 便宜
+class PCG32
+{
+public:
+    PCG32(uint64_t initState = 0x853c49e6748fea9bULL, uint64_t initSeq = 0xda3e39cb94b95bdbULL)
+    {
+        seed(initState, initSeq);
+    }
+
+    // 设置初始状态和序列号（不同序列号得到互不相关的随机数流）
+    void seed(uint64_t initState, uint64_t initSeq)
+    {
+        state = 0u;
+        inc = (initSeq << 1u) | 1u;
+        nextUInt();
+        state += initState;
+        nextUInt();
+    }
+
+    // 生成一个 32 位无符号随机整数
+    uint32_t nextUInt()
+    {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ULL + inc;
+        uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+        uint32_t rot = (uint32_t)(oldState >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+    }
+
+    // 生成一个 [0, 1) 之间的浮点随机数
+    float nextFloat()
+    {
+        // 取高 24 位，保证结果严格小于 1
+        return (nextUInt() >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+// 64 位整数哈希（splitmix64 的输出函数），用于把像素编号和采样编号打散成种子
+inline uint64_t mixBits(uint64_t v)
+{
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+// 32 位整数按位翻转
+inline uint32_t reverseBits(uint32_t v)
+{
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// 基于哈希的 Owen 置乱（Burley 2020, "Practical Hash-based Owen Scrambling"）：
+// 对 x 的每一位按其更高位的值做随机翻转，不同 seed 得到互不相关的置乱，且保持 (0,m,2) 网格的分层性质
+inline uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return reverseBits(x);
+}
+
+// Sobol 序列的前两维：第 0 维即 van der Corput 序列（索引按位翻转），
+// 第 1 维的方向数由本原多项式 x + 1 生成，v_k = v_{k-1} ^ (v_{k-1} >> 1)
+inline uint32_t sobolDim0(uint32_t index) { return reverseBits(index); }
+inline uint32_t sobolDim1(uint32_t index)
+{
+    uint32_t r = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+        if (index & 1)
+            r ^= v;
+    return r;
+}
+
+// 采样器类型：独立随机数（PCG32）/ Owen 置乱的 Sobol 低差异序列
+enum SamplerType { INDEPENDENT_SAMPLER, SOBOL_SAMPLER };
+
+// 采样器：每个线程持有一个，在每个像素的每次采样开始时按（像素编号，采样编号）重新播种，
+// 因此同一像素同一次采样得到的随机数序列是确定的，与线程划分和执行顺序无关。
+//
+// SOBOL_SAMPLER 按维度分流：一次采样中第 d 次请求的 1D / 2D 样本，取自该像素第 d 个维度的
+// 低差异序列在 sampleIndex 处的值。每个维度只用 Sobol 的前一维或前两维，
+// 但采样编号先经过一次与维度相关的 Owen 置乱（打乱各维度之间的对应关系），
+// 取出的值再按（像素，维度）独立置乱，因此不需要高维方向数表，也不会在维度之间产生相关性
+class Sampler
+{
+public:
+    explicit Sampler(uint64_t seed = 0, SamplerType type = SOBOL_SAMPLER) : seed(seed), type(type) {}
+
+    // 开始第 pixelIndex 个像素的第 sampleIndex 次采样
+    void startPixelSample(uint32_t pixelIndex, uint32_t sampleIndex)
+    {
+        if (type == INDEPENDENT_SAMPLER) {
+            rng.seed(mixBits(((uint64_t)pixelIndex << 32) ^ sampleIndex ^ seed), pixelIndex);
+            return;
+        }
+        pixelSeed = mixBits(((uint64_t)pixelIndex << 32) ^ seed);
+        this->sampleIndex = sampleIndex;
+        dimension = 0;
+    }
+
+    // 一维 [0, 1) 样本
+    float get1D()
+    {
+        if (type == INDEPENDENT_SAMPLER)
+            return rng.nextFloat();
+        uint64_t h = mixBits(pixelSeed ^ dimension++);
+        uint32_t index = owenScramble(sampleIndex, (uint32_t)h);
+        return toFloat(owenScramble(sobolDim0(index), (uint32_t)(h >> 32)));
+    }
+
+    // 二维 [0, 1)^2 样本
+    Vector2f get2D()
+    {
+        if (type == INDEPENDENT_SAMPLER) {
+            float u = rng.nextFloat();
+            float v = rng.nextFloat();
+            return Vector2f(u, v);
+        }
+        uint64_t h = mixBits(pixelSeed ^ dimension++);
+        uint32_t index = owenScramble(sampleIndex, (uint32_t)h);
+        uint32_t seedY = (uint32_t)mixBits(h);
+        return Vector2f(toFloat(owenScramble(sobolDim0(index), (uint32_t)(h >> 32))),
+                        toFloat(owenScramble(sobolDim1(index), seedY)));
+    }
+
+    SamplerType getType() const { return type; }
+
+private:
+    // 取高 24 位转换为 [0, 1) 浮点数，保证结果严格小于 1
+    static float toFloat(uint32_t v) { return (v >> 8) * (1.0f / 16777216.0f); }
+
+    uint64_t seed;
+    SamplerType type;
+    PCG32 rng;               // INDEPENDENT_SAMPLER 的随机数发生器
+
+    uint64_t pixelSeed = 0;  // SOBOL_SAMPLER：当前像素的置乱种子
+    uint32_t sampleIndex = 0;// SOBOL_SAMPLER：当前采样编号
+    uint32_t dimension = 0;  // SOBOL_SAMPLER：本次采样已经用掉的维度数
+};
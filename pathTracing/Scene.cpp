@@ -3,7 +3,32 @@
 
 void Scene::buildBVH() {
     printf(" - Generating BVH...\n\n");
-    this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    this->bvh = new BVHAccel(objects, maxPrimsInNode, splitMethod, bvhWidth);
+    buildLightDistribution();
+    printf(" - Light distribution: %zu emitters\n", emitters.size());
+}
+
+bool Scene::refitBVH(float maxCostGrowth)
+{
+    bool rebuilt = bvh->refit(maxCostGrowth);
+    buildLightDistribution();
+    return rebuilt;
+}
+
+void Scene::buildLightDistribution()
+{
+    emitters.clear();
+    emitterIndex.clear();
+    for (auto obj : objects)
+        obj->collectEmitters(emitters);
+    for (uint32_t k = 0; k < emitters.size(); ++k)
+        emitterIndex[emitters[k]] = k;
+
+    std::vector<float> weights;
+    weights.reserve(emitters.size());
+    for (auto e : emitters)
+        weights.push_back(e->getArea());
+    lightDistribution.build(weights);
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -11,43 +36,85 @@ Intersection Scene::intersect(const Ray &ray) const
     return this->bvh->Intersect(ray);
 }
 
+bool Scene::intersectP(const Ray &ray, float tMax) const
+{
+    return this->bvh->IntersectP(ray, tMax);
+}
+
+void Scene::intersect(const Ray* rays, Intersection* hits, size_t count) const
+{
+    this->bvh->Intersect(rays, hits, count);
+}
+
+void Scene::intersectP(const Ray* rays, const float* tMax, char* occluded, size_t count) const
+{
+    this->bvh->IntersectP(rays, tMax, occluded, count);
+}
+
+uint64_t Scene::hash() const
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = hashValue(h, RussianRoulette);
+    h = hashValue(h, mis);
+    for (auto obj : objects) {
+        Bounds3 b = obj->getBounds();
+        h = hashValue(h, b.pMin);
+        h = hashValue(h, b.pMax);
+        h = hashValue(h, obj->getArea());
+        Material* m = obj->getMaterial();
+        h = hashValue(h, m->m_type);
+        h = hashValue(h, m->m_emission);
+        h = hashValue(h, m->Kd);
+        h = hashValue(h, m->Ks);
+        h = hashValue(h, m->ior);
+        h = hashValue(h, m->roughness);
+        h = hashValue(h, m->diffuseSampling);
+    }
+    return hashValue(h, emitters.size());
+}
+
 //sampleLight : 得到lightInter（场景中光源区域的任意一点），pdf（该光源的密度）
-void Scene::sampleLight(Intersection &pos, float &pdf) const
+void Scene::sampleLight(Intersection &pos, float &pdf, Sampler &sampler) const
 {
 	/**
 	 * @brief 
 	 * pos:得到lightInter（场景中光源区域的任意一点），
 	 * pdf:pdf（该光源的概率密度）
 	 */
-    float emit_area_sum = 0; //保存总的光源面积（为均匀分布的概率中找到obj使用）
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-        }
+    if (lightDistribution.empty()) {
+        pdf = 0;
+        return;
     }
+	//按光源面积比例，通过别名表随机找到一个发光面，再在这个发光面中找到一个点
+    float pickPdf;
+    uint32_t k = lightDistribution.sample(sampler.get1D(), pickPdf);
+    emitters[k]->Sample(pos, pdf, sampler);//pos为该发光面中随机找到的一个点，pdf为 1/该发光面的面积
+    pdf *= pickPdf; // 面积加权后即为 1/总发光面积
+}
 
-	//随机生成一个服从[0,1]的均匀分布的数
-    float p = get_random_float() * emit_area_sum;
-    emit_area_sum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-            if (p <= emit_area_sum){//按光源面积比例，随机找到一个光源面，再在这个光源面中找到一个点
-				//这里调用的是 MeshTriangle 中的 Sample
-                objects[k]->Sample(pos, pdf);//pos为该光源面中随机找到的一个点，pdf为 1/该模型的面积
-                break;
-            }
-        }
-    }
+float Scene::pdfLight(const Object* light) const
+{
+    auto it = emitterIndex.find(light);
+    if (it == emitterIndex.end())
+        return 0.0f;
+    // 选中该发光面的概率 * 在该发光面上均匀取点的密度
+    return lightDistribution.pmf(it->second) / emitters[it->second]->getArea();
 }
 
 
 // Implementation of Path Tracing
-Vector3f Scene::castRay(const Ray &ray, int depth) const
+Vector3f Scene::castRay(const Ray &ray, int depth, Sampler &sampler) const
+{
+	// 1.
+	// 光线 与 BVH 求交
+	return shade(ray, intersect(ray), depth, sampler);
+}
+
+Vector3f Scene::shade(const Ray &ray, const Intersection &inter, int depth, Sampler &sampler) const
 {
 	/**
 	 * @brief 路径追踪
-	 * 1.求出该光线与场景的交点
+	 * 1.求出该光线与场景的交点（castRay 中完成，交点作为 inter 传入）
 	 * 2.如果交点为光源
 	 		如果射线第一次打到光源，则直接返回光源颜色。
 			如果射线打到光源，但不是该像素的直接光照，则返回0。该问题在交点为物体时求解。
@@ -55,12 +122,10 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
 	 		生成一条由该物体指向随机生成的光源的一条光线，与场景求交，交点为light2obj
 			如果该光线击中光源，计算直接光照值
 			（递归）光线是否继续弹射，计算间接光照？（俄罗斯轮盘赌）
+			开启 MIS 时，BSDF 采样的弹射光线打到光源也计入直接光照，两种采样策略按幂启发式加权
 	 * 4.返回得到的光线值
 	 */
 
-	// 1.
-	// 光线 与 BVH 求交
-	Intersection inter = intersect(ray);
 	if (inter.happened)
 	{
 		// 2.
@@ -83,7 +148,7 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
 		// lightInter（场景中光源区域的任意一点），pdf（该光源的概率密度）
 		Intersection lightInter;
 		float pdf_light = 0.0f;
-		sampleLight(lightInter, pdf_light);
+		sampleLight(lightInter, pdf_light, sampler);
 
 		// 物体表面法线
 		auto& N = inter.normal;
@@ -98,36 +163,54 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
 		float lightDistance = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
 
 		Ray light(objPos, lightDir);
-		// 与场景求交，交点为light2obj 
-		Intersection light2obj = intersect(light);
-
+		float cosTheta = dotProduct(lightDir, N);
+		float cosThetaLight = dotProduct(-lightDir, NN);
 
-		// 如果该光线击中光源（及该光源可以直接照射到该点），计算直接光照值
-		if (light2obj.happened && (light2obj.coords - lightPos).norm() < 1e-2)
+		// 光源点位于物体正面、物体位于光源正面，并且两者之间没有遮挡（阴影射线在到达光源前 1e-2 处截止），
+		// 才计算直接光照值
+		if (cosTheta > 0 && cosThetaLight > 0 && !intersectP(light, std::sqrt(lightDistance) - 1e-2f))
 		{
 			//获取改材质的brdf，这里的 BRDF 为漫反射（brdf=Kd/pi）
 			Vector3f f_r = inter.m->eval(ray.direction, lightDir, N);
 			
 			//直接光照光 = 光源光 * brdf * 光线和物体角度衰减 * 光线和光源法线角度衰减 / 光线距离 / 该点的概率密度（1/该光源的面积）
-			L_dir = lightInter.emit * f_r * dotProduct(lightDir, N) * dotProduct(-lightDir, NN) / lightDistance / pdf_light;
+			L_dir = lightInter.emit * f_r * cosTheta * cosThetaLight / lightDistance / pdf_light;
+
+			// MIS：把光源采样的面积 pdf 换算到立体角，与 BSDF 在同一方向上的 pdf 比较
+			if (mis)
+				L_dir = L_dir * powerHeuristic(pdf_light * lightDistance / cosThetaLight, inter.m->pdf(ray.direction, lightDir, N));
 		}
 
 		//俄罗斯轮盘赌，确定是否继续弹射光线
-		if (get_random_float() < RussianRoulette)
+		if (sampler.get1D() < RussianRoulette)
 		{
 			//获取半平面上的随机弹射方向
-			Vector3f nextDir = inter.m->sample(ray.direction, N).normalized();
+			Vector3f nextDir = inter.m->sample(ray.direction, N, sampler).normalized();
 			//定义弹射光线
 			Ray nextRay(objPos, nextDir);
 			//获取相交点
 			Intersection nextInter = intersect(nextRay);
-			//如果有相交，且是与物体相交
-			if (nextInter.happened && !nextInter.m->hasEmission())
+			//如果有相交（pdf 为 0 说明采样方向落在表面以下，没有贡献）
+			float pdf = inter.m->pdf(ray.direction, nextDir, N);
+			if (pdf > 0.0f && nextInter.happened)
 			{
-				//该点间接光= 弹射点反射光 * brdf * 角度衰减 / pdf(认为该点四面八方都接收到了该方向的光强，为1/(2*pi)) / 俄罗斯轮盘赌值(强度矫正值)
-				float pdf = inter.m->pdf(ray.direction, nextDir, N);
 				Vector3f f_r = inter.m->eval(ray.direction, nextDir, N);
-				L_indir = castRay(nextRay, depth + 1) * f_r * dotProduct(nextDir, N) / pdf / RussianRoulette;
+				Vector3f beta = f_r * dotProduct(nextDir, N) / pdf / RussianRoulette;
+				if (!nextInter.m->hasEmission())
+				{
+					//与物体相交：该点间接光= 弹射点反射光 * brdf * 角度衰减 / pdf / 俄罗斯轮盘赌值(强度矫正值)
+					L_indir = shade(nextRay, nextInter, depth + 1, sampler) * beta;
+				}
+				else if (mis)
+				{
+					//与光源相交：按 MIS 权重计入光源颜色，光源的面积 pdf 同样换算到立体角
+					float cosThetaLight = dotProduct(-nextDir, nextInter.normal);
+					if (cosThetaLight > 0)
+					{
+						float pdf_light = pdfLight(nextInter.obj) * nextInter.distance * nextInter.distance / cosThetaLight;
+						L_indir = nextInter.m->getEmission() * beta * powerHeuristic(pdf, pdf_light);
+					}
+				}
 			}
 		}
 
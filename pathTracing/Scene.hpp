@@ -2,12 +2,14 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include "Vector.hpp"
 #include "Object.hpp"
 #include "Light.hpp"
 #include "AreaLight.hpp"
 #include "BVH.hpp"
 #include "Ray.hpp"
+#include "AliasTable.hpp"
 
 
 class Scene
@@ -20,6 +22,12 @@ public:
     Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
     int maxDepth = 1;
     float RussianRoulette = 0.9;
+    // BVH 构建选项：划分方法（NAIVE / SAH）与叶子节点的最大物体数
+    BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE;
+    int maxPrimsInNode = 1;
+    int bvhWidth = 2; // 2 为二叉 BVH，4 / 8 为 SIMD 多叉 BVH
+    bool meshCache = true; // 网格使用二进制缓存（<obj>.ptmesh），第二次运行起不再解析 OBJ、不再构建网格 BVH
+    bool mis = true;  // 光源采样与 BSDF 采样之间使用多重重要性采样（幂启发式），false 时只用光源采样估计直接光照
 
     Scene(int w, int h) : width(w), height(h)
     {}
@@ -31,16 +39,37 @@ public:
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     // 该函数调用场景bvh类中的求交函数
     Intersection intersect(const Ray& ray) const;
+    // 阴影射线：判断射线在 [0, tMax) 范围内是否被遮挡，找到第一个遮挡物即返回
+    bool intersectP(const Ray& ray, float tMax) const;
+    // 批量求交 / 批量遮挡测试（波前积分器使用），目前逐条转发给 BVH 的单光线遍历，见 BVHAccel 的批量版本
+    void intersect(const Ray* rays, Intersection* hits, size_t count) const;
+    void intersectP(const Ray* rays, const float* tMax, char* occluded, size_t count) const;
     // 场景中的 bvh， 用来划分 obj
     BVHAccel *bvh;
     void buildBVH();
-    Vector3f castRay(const Ray &ray, int depth) const;
-    void sampleLight(Intersection &pos, float &pdf) const;
+    // 收集所有发光面并按面积建立别名表，buildBVH 之后调用
+    void buildLightDistribution();
+    // 物体移动或变形（例如 MeshTriangle::updateVertices）之后调用：refit 场景 BVH 并重建光源分布，
+    // maxCostGrowth 的含义见 BVHAccel::refit，返回是否重新构建了场景 BVH
+    bool refitBVH(float maxCostGrowth = 0);
+    Vector3f castRay(const Ray &ray, int depth, Sampler &sampler) const;
+    // 已知光线 ray 与场景的交点 inter 时直接着色（castRay = intersect + shade），
+    // 同一条主光线的多个采样可以共用一次求交
+    Vector3f shade(const Ray &ray, const Intersection &inter, int depth, Sampler &sampler) const;
+    void sampleLight(Intersection &pos, float &pdf, Sampler &sampler) const;
+    // 场景哈希：由积分器选项和每个物体的包围盒、面积、材质参数计算（相机由 Renderer 另外计入），检查点用它确认恢复的是同一个场景
+    uint64_t hash() const;
+    // sampleLight 采到发光面 light 上某一点的面积概率密度（light 不是发光面时为 0）
+    float pdfLight(const Object* light) const;
 
     // creating the scene (adding objects and lights)
     std::vector<Object* > objects;               //模型指针集合
     std::vector<std::unique_ptr<Light> > lights; //光源指针集合
 
+    std::vector<Object*> emitters; // 所有发光物体（发光网格整体作为一个发光面，在网格内按面积采样三角形）
+    AliasTable lightDistribution;  // emitters 上按面积比例的离散分布
+    std::unordered_map<const Object*, uint32_t> emitterIndex; // 发光面 -> 在 emitters 中的下标
+
 
 //     // Compute Fresnel equation
 // //
@@ -79,6 +79,19 @@ public:
 
     }
 
+    // 判断射线在 [0, tMax) 范围内是否被球体遮挡（与 getIntersection 使用相同的判定）
+    bool intersectP(const Ray& ray, float tMax){
+        Vector3f L = ray.origin - center;
+        float a = dotProduct(ray.direction, ray.direction);
+        float b = 2 * dotProduct(ray.direction, L);
+        float c = dotProduct(L, L) - radius2;
+        float t0, t1;
+        if (!solveQuadratic(a, b, c, t0, t1)) return false;
+        if (t0 < 0) t0 = t1;
+        if (t0 < 0) return false;
+        return t0 > 0.5 && t0 < tMax;
+    }
+
     // 获取球体表面的漫反射颜色（这里返回空向量，需要根据具体材质进行实现）
     Vector3f evalDiffuseColor(const Vector2f &st)const {
         //return m->getColor();
@@ -97,8 +110,9 @@ public:
     }
 
     // 在球体表面随机采样一点并计算其概率密度函数（pdf）
-    void Sample(Intersection &pos, float &pdf){
-        float theta = 2.0 * M_PI * get_random_float(), phi = M_PI * get_random_float();
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler){
+        Vector2f u = sampler.get2D();
+        float theta = 2.0 * M_PI * u.x, phi = M_PI * u.y;
         Vector3f dir(std::cos(phi), std::sin(phi)*std::cos(theta), std::sin(phi)*std::sin(theta));
         pos.coords = center + radius * dir;
         pos.normal = dir;
@@ -115,6 +129,10 @@ public:
     bool hasEmit(){
         return m->hasEmission();
     }
+
+    Material* getMaterial(){
+        return m;
+    }
 };
 
 
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 图像中的一个矩形分块，范围为 [x0, x1) x [y0, y1)
+struct Tile
+{
+    int x0, y0; // 左上角像素坐标
+    int x1, y1; // 右下角像素坐标（不包含）
+    int index;  // 分块编号（按行优先排列）
+};
+
+// 分块调度器：把图像切成小块，平均分配到每个工作线程的队列中。
+// 线程优先从自己队列的头部取块，自己的队列空了之后再从其他线程队列的尾部“窃取”，
+// 这样耗时不均匀的区域（高光、阴影、光源附近）不会让其他核心在最后阶段空等。
+class TileScheduler
+{
+public:
+    // keep 非空时只调度 keep 返回 true 的分块（自适应采样时跳过已经收敛的分块），
+    // 剩下的分块仍然平均分配到各线程
+    TileScheduler(int width, int height, int tileSize, int numWorkers,
+                  const std::function<bool(const Tile&)>& keep = nullptr)
+    {
+        tileSize = std::max(1, tileSize);
+        numWorkers = std::max(1, numWorkers);
+
+        for (int y = 0; y < height; y += tileSize) {
+            for (int x = 0; x < width; x += tileSize) {
+                Tile tile;
+                tile.x0 = x;
+                tile.y0 = y;
+                tile.x1 = std::min(x + tileSize, width);
+                tile.y1 = std::min(y + tileSize, height);
+                tile.index = (y / tileSize) * ((width + tileSize - 1) / tileSize) + x / tileSize;
+                if (!keep || keep(tile))
+                    tiles.push_back(tile);
+            }
+        }
+
+        // 每个线程分到一段连续的分块，保持访问的局部性
+        for (int w = 0; w < numWorkers; ++w)
+            queues.emplace_back(new WorkQueue());
+        size_t n = tiles.size();
+        for (int w = 0; w < numWorkers; ++w) {
+            size_t begin = n * w / numWorkers;
+            size_t end = n * (w + 1) / numWorkers;
+            for (size_t i = begin; i < end; ++i)
+                queues[w]->tiles.push_back(tiles[i]);
+        }
+    }
+
+    // 为第 worker 个线程取下一个分块，所有分块都已取完时返回 false
+    bool next(int worker, Tile& tile)
+    {
+        // 1. 从自己的队列头部取
+        {
+            WorkQueue& own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.tiles.empty()) {
+                tile = own.tiles.front();
+                own.tiles.pop_front();
+                return true;
+            }
+        }
+
+        // 2. 依次从其他线程队列的尾部窃取
+        int numWorkers = (int)queues.size();
+        for (int k = 1; k < numWorkers; ++k) {
+            WorkQueue& victim = *queues[(worker + k) % numWorkers];
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            if (!victim.tiles.empty()) {
+                tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int numTiles() const { return (int)tiles.size(); }
+    int numWorkers() const { return (int)queues.size(); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mtx;
+        std::deque<Tile> tiles;
+    };
+
+    std::vector<Tile> tiles;                        // 所有分块
+    std::vector<std::unique_ptr<WorkQueue> > queues; // 每个工作线程的任务队列
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cmath>
+#include "Vector.hpp"
+#include "Bounds3.hpp"
+#include "global.hpp"
+
+// 仿射变换：3x4 矩阵，左侧 3x3 为线性部分，最后一列为平移，点 p 变换为 m * (p, 1)
+class Transform
+{
+public:
+    // 单位变换
+    Transform()
+    {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = (i == j) ? 1.0f : 0.0f;
+    }
+
+    static Transform translate(const Vector3f& t)
+    {
+        Transform r;
+        r.m[0][3] = t.x;
+        r.m[1][3] = t.y;
+        r.m[2][3] = t.z;
+        return r;
+    }
+
+    static Transform scale(const Vector3f& s)
+    {
+        Transform r;
+        r.m[0][0] = s.x;
+        r.m[1][1] = s.y;
+        r.m[2][2] = s.z;
+        return r;
+    }
+
+    // 绕过原点的 axis 轴旋转 degrees 度（Rodrigues 公式）
+    static Transform rotate(const Vector3f& axis, float degrees)
+    {
+        Vector3f a = normalize(axis);
+        float theta = degrees * M_PI / 180.0f;
+        float c = std::cos(theta), s = std::sin(theta), t = 1 - c;
+        Transform r;
+        r.m[0][0] = t * a.x * a.x + c;       r.m[0][1] = t * a.x * a.y - s * a.z; r.m[0][2] = t * a.x * a.z + s * a.y;
+        r.m[1][0] = t * a.x * a.y + s * a.z; r.m[1][1] = t * a.y * a.y + c;       r.m[1][2] = t * a.y * a.z - s * a.x;
+        r.m[2][0] = t * a.x * a.z - s * a.y; r.m[2][1] = t * a.y * a.z + s * a.x; r.m[2][2] = t * a.z * a.z + c;
+        return r;
+    }
+
+    // 复合变换：先做 b 再做 *this
+    Transform operator*(const Transform& b) const
+    {
+        Transform r;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+                if (j == 3)
+                    r.m[i][j] += m[i][3];
+            }
+        }
+        return r;
+    }
+
+    // 线性部分的行列式
+    float determinant() const
+    {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+             - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+             + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    // 逆变换（线性部分必须可逆）
+    Transform inverse() const
+    {
+        Transform r;
+        float invDet = 1.0f / determinant();
+        r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet;
+        r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * invDet;
+        r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet;
+        r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+        // 平移部分：-A^-1 * t
+        for (int i = 0; i < 3; ++i)
+            r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+        return r;
+    }
+
+    // 变换点（含平移）
+    Vector3f point(const Vector3f& p) const
+    {
+        return Vector3f(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    // 变换方向（不含平移）
+    Vector3f vector(const Vector3f& v) const
+    {
+        return Vector3f(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // 用线性部分的转置变换方向：在逆变换上调用即为法线的变换（逆转置），结果未归一化
+    Vector3f transposeVector(const Vector3f& v) const
+    {
+        return Vector3f(m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                        m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                        m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z);
+    }
+
+    // 变换包围盒（Arvo 的方法：逐个矩阵元素累加最小、最大值，不需要变换 8 个角点）
+    Bounds3 bounds(const Bounds3& b) const
+    {
+        float lo[3], hi[3];
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = hi[i] = m[i][3];
+            for (int j = 0; j < 3; ++j) {
+                float e = m[i][j] * b.pMin[j], f = m[i][j] * b.pMax[j];
+                lo[i] += std::min(e, f);
+                hi[i] += std::max(e, f);
+            }
+        }
+        return Bounds3(Vector3f(lo[0], lo[1], lo[2]), Vector3f(hi[0], hi[1], hi[2]));
+    }
+
+    float m[3][4];
+};
@@ -3,10 +3,12 @@
 #include "BVH.hpp"
 #include "Intersection.hpp"
 #include "Material.hpp"
-#include "OBJ_Loader.hpp"
+#include "MeshCache.hpp"
+#include "ObjReader.hpp"
 #include "Object.hpp"
 #include "Triangle.hpp"
 #include <cassert>
+#include <cstdlib>
 #include <array>
 
 // 判断射线和三角形是否相交，如果相交则返回交点的参数u、v和距离tnear
@@ -59,8 +61,17 @@ public:
 
     // 构造函数，传入三个顶点和材质指针
     Triangle(Vector3f _v0, Vector3f _v1, Vector3f _v2, Material* _m = nullptr)
-        : v0(_v0), v1(_v1), v2(_v2), m(_m)
+        : m(_m)
     {
+        setVertices(_v0, _v1, _v2);
+    }
+
+    // 设置三个顶点并重新计算边、法线和面积（网格变形时使用）
+    void setVertices(const Vector3f& _v0, const Vector3f& _v1, const Vector3f& _v2)
+    {
+        v0 = _v0;
+        v1 = _v1;
+        v2 = _v2;
         e1 = v1 - v0;
         e2 = v2 - v0;
         normal = normalize(crossProduct(e1, e2));
@@ -75,6 +86,8 @@ public:
 
     // 返回射线与三角形的交点信息
     Intersection getIntersection(Ray ray) override;
+    // 判断射线在 [0, tMax) 范围内是否与三角形相交（阴影射线用）
+    bool intersectP(const Ray& ray, float tMax) override;
 
     // 获取表面属性，例如法线和纹理坐标
     void getSurfaceProperties(const Vector3f& P, const Vector3f& I,
@@ -93,17 +106,18 @@ public:
     Bounds3 getBounds() override;
 
     // 在三角形上采样一个点，并返回采样点的概率密度函数（pdf）
-    void Sample(Intersection &pos, float &pdf){
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler){
         // 随机得到三角形内一点，并得到该点pdf（该点的概率密度）为1/三角形面积
 
-
-        float x = std::sqrt(get_random_float()); 
-        float y = get_random_float();// 0-1
+        Vector2f u = sampler.get2D();// 0-1
+        float x = std::sqrt(u.x);
+        float y = u.y;
 
         //随机得到三角形内一点
         pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);//???
         pos.normal = this->normal;
-        
+        pos.emit = m->getEmission();
+
         //得到该点pdf（该点的概率密度）为1/三角形面积
         pdf = 1.0f / area;
     }
@@ -117,63 +131,73 @@ public:
     bool hasEmit(){
         return m->hasEmission();
     }
+
+    // 获取材质
+    Material* getMaterial(){
+        return m;
+    }
 };
 
 // MeshTriangle类，用于加载OBJ文件的三角形网格模型
 class MeshTriangle : public Object
 {
 public:
-    // 构造函数，从OBJ文件加载三角形网格模型
-    MeshTriangle(const std::string& filename, Material *mt = new Material())
+    // 构造函数，从OBJ文件加载三角形网格模型，splitMethod/maxPrimsInNode/bvhWidth 为网格内部 BVH 的构建选项，
+    // useCache 为 true 时优先读取二进制网格缓存（包括预构建的 BVH），没有可用缓存时解析 OBJ 并写出缓存
+    MeshTriangle(const std::string& filename, Material *mt = new Material(),
+                 BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE,
+                 int maxPrimsInNode = 1, int bvhWidth = 2, bool useCache = false)
     {
-        // 从OBJ文件加载三角形网格
-        objl::Loader loader;
-        loader.LoadFile(filename);
-        area = 0;
+        // 从缓存或OBJ文件加载三角形网格
+        ObjMesh mesh;
+        uint64_t checksum = 0;
+        std::vector<uint32_t> primOrder;
+        std::vector<LinearBVHNode> nodes;
+        bool cached = useCache && MeshCache::load(filename, splitMethod, maxPrimsInNode, mesh, checksum, primOrder, nodes);
+        // 校验值只在写出缓存时需要
+        if (!cached && !ObjReader::read(filename, mesh, 0, useCache ? &checksum : nullptr)) {
+            std::cerr << "Cannot load OBJ file " << filename << "\n";
+            std::exit(1);
+        }
         m = mt;
-        assert(loader.LoadedMeshes.size() == 1);
-        auto mesh = loader.LoadedMeshes[0];
-
-        Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
-                                     std::numeric_limits<float>::infinity(),
-                                     std::numeric_limits<float>::infinity()};
-        Vector3f max_vert = Vector3f{-std::numeric_limits<float>::infinity(),
-                                     -std::numeric_limits<float>::infinity(),
-                                     -std::numeric_limits<float>::infinity()};
-
-        // 遍历所有三角形面片，并创建对应的Triangle对象
-        for (int i = 0; i < mesh.Vertices.size(); i += 3) {
-            std::array<Vector3f, 3> face_vertices;
-
-            for (int j = 0; j < 3; j++) {
-                auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
-                                     mesh.Vertices[i + j].Position.Y,
-                                     mesh.Vertices[i + j].Position.Z);
-                face_vertices[j] = vert;
-
-                // 更新包围盒的边界
-                min_vert = Vector3f(std::min(min_vert.x, vert.x),
-                                    std::min(min_vert.y, vert.y),
-                                    std::min(min_vert.z, vert.z));
-                max_vert = Vector3f(std::max(max_vert.x, vert.x),
-                                    std::max(max_vert.y, vert.y),
-                                    std::max(max_vert.z, vert.z));
-            }
 
-            // 创建Triangle对象并加入到triangles列表中
-            triangles.emplace_back(face_vertices[0], face_vertices[1],
-                                   face_vertices[2], mt);
-        }
+        // 网格只保存共享的顶点缓冲和下标缓冲，不为每个三角形创建物体；
+        // 求交用的预计算数据由网格的 BVH 按叶子顺序保存
+        numVertices = (uint32_t)mesh.positions.size();
+        numTriangles = (uint32_t)(mesh.indices.size() / 3);
+        vertices.reset(new Vector3f[numVertices]);
+        std::copy(mesh.positions.begin(), mesh.positions.end(), vertices.get());
+        vertexIndex.reset(new uint32_t[mesh.indices.size()]);
+        std::copy(mesh.indices.begin(), mesh.indices.end(), vertexIndex.get());
+        updateBoundsAndArea();
 
         // 创建BVH加速结构，加速三角形的相交测试
-        bounding_box = Bounds3(min_vert, max_vert); 
-
-        std::vector<Object*> ptrs;  
-        for (auto& tri : triangles){
-            ptrs.push_back(&tri);
-            area += tri.area;
+        if (!nodes.empty()) {
+            // 缓存中的 BVH：直接使用保存的叶子顺序，不需要重新构建
+            bvh = new BVHAccel(this, m, vertices.get(), vertexIndex.get(), std::move(primOrder), std::move(nodes),
+                               maxPrimsInNode, splitMethod, bvhWidth);
+            return;
         }
-        bvh = new BVHAccel(ptrs);
+        bvh = new BVHAccel(this, m, vertices.get(), vertexIndex.get(), numTriangles, maxPrimsInNode, splitMethod, bvhWidth);
+
+        // BVH 叶子顺序对应的三角形编号连同网格一起写入缓存
+        if (useCache && !MeshCache::save(filename, splitMethod, maxPrimsInNode, mesh, checksum, bvh->triangleIndex, bvh->nodes))
+            std::cerr << "Cannot write mesh cache " << MeshCache::cachePath(filename) << "\n";
+    }
+
+    // 更新网格的顶点位置（顶点数和拓扑不变，positions 与 OBJ 中的顶点一一对应），
+    // 然后重算包围盒和面积，并 refit 网格内部的 BVH；maxCostGrowth 的含义见 BVHAccel::refit，rebuilt 不为空时返回是否重新构建了 BVH。
+    // positions 的个数与网格顶点数不同时不做任何修改，返回 false。网格所在场景随后需要调用 Scene::refitBVH
+    bool updateVertices(const std::vector<Vector3f>& positions, float maxCostGrowth = 0, bool* rebuilt = nullptr)
+    {
+        if (positions.size() != numVertices)
+            return false;
+        std::copy(positions.begin(), positions.end(), vertices.get());
+        updateBoundsAndArea();
+        bool refitRebuilt = bvh->refit(maxCostGrowth);
+        if (rebuilt)
+            *rebuilt = refitRebuilt;
+        return true;
     }
 
     // 判断射线和三角形网格是否相交
@@ -242,11 +266,17 @@ public:
 
         return intersec;
     }
+
+    // 判断射线在 [0, tMax) 范围内是否被网格遮挡
+    bool intersectP(const Ray& ray, float tMax)
+    {
+        return bvh && bvh->IntersectP(ray, tMax);
+    }
     
     // 在三角形网格上采样一个点，并返回采样点的概率密度函数（pdf）
-    void Sample(Intersection &pos, float &pdf){
+    void Sample(Intersection &pos, float &pdf, Sampler &sampler){
         //首先通过bvh随机采样三角形，在通过这个三角形随机采样光源
-        bvh->Sample(pos, pdf);
+        bvh->Sample(pos, pdf, sampler);
         pos.emit = m->getEmission();
     }
 
@@ -260,14 +290,33 @@ public:
         return m->hasEmission();
     }
 
+    // 获取材质
+    Material* getMaterial(){
+        return m;
+    }
+
+    // 由顶点缓冲和下标缓冲重新计算包围盒和表面积
+    void updateBoundsAndArea()
+    {
+        Bounds3 bounds;
+        area = 0;
+        for (uint32_t k = 0; k < numTriangles; ++k) {
+            const Vector3f& a = vertices[vertexIndex[3 * k]];
+            const Vector3f& b = vertices[vertexIndex[3 * k + 1]];
+            const Vector3f& c = vertices[vertexIndex[3 * k + 2]];
+            bounds = Union(Union(Union(bounds, a), b), c);
+            area += crossProduct(b - a, c - a).norm() * 0.5f;
+        }
+        bounding_box = bounds;
+    }
+
     Bounds3 bounding_box; //包围盒  
     std::unique_ptr<Vector3f[]> vertices; //顶点集合的指针
+    uint32_t numVertices;   //顶点数量
     uint32_t numTriangles;  //三角形数量
     std::unique_ptr<uint32_t[]> vertexIndex;    //顶点集合索引
     std::unique_ptr<Vector2f[]> stCoordinates;  //纹理坐标集合的指针
 
-    std::vector<Triangle> triangles;    //三角形集合
-
     BVHAccel* bvh; //MeshTriangle 的 bvh树的根指针（用来划分三角形）
     float area; //表面积之和
 
@@ -336,6 +385,31 @@ inline Intersection Triangle::getIntersection(Ray ray)
 	return inter;
 }
 
+// 与 getIntersection 相同的相交测试（同样剔除背面），但只返回是否相交
+inline bool Triangle::intersectP(const Ray& ray, float tMax)
+{
+	if (dotProduct(ray.direction, normal) > 0)
+		return false;
+
+	Vector3f pvec = crossProduct(ray.direction, e2);
+	double det = dotProduct(e1, pvec);
+	if (fabs(det) < EPSILON)
+		return false;
+
+	double det_inv = 1. / det;
+	Vector3f tvec = ray.origin - v0;
+	double u = dotProduct(tvec, pvec) * det_inv;
+	if (u < 0 || u > 1)
+		return false;
+	Vector3f qvec = crossProduct(tvec, e1);
+	double v = dotProduct(ray.direction, qvec) * det_inv;
+	if (v < 0 || u + v > 1)
+		return false;
+
+	double t = dotProduct(e2, qvec) * det_inv;
+	return t >= 0 && t < tMax;
+}
+
 // 获取三角形表面的漫反射颜色，这里返回一个默认的灰色
 inline Vector3f Triangle::evalDiffuseColor(const Vector2f&) const
 {
@@ -42,7 +42,7 @@ public:
 
     // ±ڷԪ
     double       operator[](int index) const;
-    double&      operator[](int index);
+    float&       operator[](int index);
 
     // ̬Сֵ
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2) {
@@ -60,6 +60,9 @@ public:
 inline double Vector3f::operator[](int index) const {
     return (&x)[index];
 }
+inline float& Vector3f::operator[](int index) {
+    return (&x)[index];
+}
 
 
 // ά
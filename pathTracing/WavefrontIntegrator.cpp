@@ -0,0 +1,132 @@
+#include <algorithm>
+#include "WavefrontIntegrator.hpp"
+
+void WavefrontIntegrator::trace(const std::vector<Ray>& rays,
+                                std::vector<Sampler>& samplers,
+                                std::vector<Vector3f>& radiance,
+                                const std::vector<Intersection>* primaryHits)
+{
+    radiance.assign(rays.size(), Vector3f(0.0f));
+    // 分批追踪，限制队列占用的内存
+    for (size_t begin = 0; begin < rays.size(); begin += maxBatch) {
+        size_t count = std::min(maxBatch, rays.size() - begin);
+        traceBatch(&rays[begin], &samplers[begin], count, &radiance[begin],
+                   primaryHits ? &(*primaryHits)[begin] : nullptr);
+    }
+}
+
+void WavefrontIntegrator::traceBatch(const Ray* rays, Sampler* samplers, size_t count, Vector3f* radiance,
+                                     const Intersection* primaryHits)
+{
+    L = radiance;
+    this->samplers = samplers;
+    current.clear();
+    for (size_t i = 0; i < count; ++i) {
+        current.push(rays[i].origin, rays[i].direction, Vector3f(1.0f), 0.0f, (uint32_t)i);
+    }
+
+    // 每一轮处理所有路径的同一次弹射，直到所有路径都被终止
+    for (int depth = 0; current.size() > 0; ++depth) {
+        if (depth == 0 && primaryHits)
+            hits.assign(primaryHits, primaryHits + count);
+        else
+            extend();
+        shade(depth);
+        shadow();
+        std::swap(current, next);
+    }
+    L = nullptr;
+    this->samplers = nullptr;
+}
+
+void WavefrontIntegrator::extend()
+{
+    // 批量求交
+    size_t n = current.size();
+    rayBuffer.clear();
+    for (size_t i = 0; i < n; ++i)
+        rayBuffer.emplace_back(current.origin[i], current.dir[i]);
+    hits.resize(n);
+    scene.intersect(rayBuffer.data(), hits.data(), n);
+}
+
+void WavefrontIntegrator::shade(int depth)
+{
+    next.clear();
+    shadowQueue.clear();
+
+    size_t n = current.size();
+    for (size_t i = 0; i < n; ++i) {
+        const Intersection& inter = hits[i];
+        uint32_t id = current.pathId[i];
+        const Vector3f& beta = current.throughput[i];
+        const Vector3f& wi = current.dir[i];
+        Sampler& sampler = samplers[id];
+
+        // 没有交点：路径结束
+        if (!inter.happened)
+            continue;
+
+        // 打到光源：第一次直接打到时返回光源颜色；之后的弹射打到光源时，开启 MIS 则按幂启发式加权计入，
+        // 否则贡献为 0（直接光照已由光源采样计算）
+        if (inter.m->hasEmission()) {
+            if (depth == 0) {
+                L[id] += beta * inter.m->getEmission();
+            } else if (scene.mis) {
+                float cosThetaLight = dotProduct(-wi, inter.normal);
+                if (cosThetaLight > 0) {
+                    float pdf_light = scene.pdfLight(inter.obj) * inter.distance * inter.distance / cosThetaLight;
+                    L[id] += beta * inter.m->getEmission() * powerHeuristic(current.bsdfPdf[i], pdf_light);
+                }
+            }
+            continue;
+        }
+
+        // 直接光照：采样光源，生成阴影射线
+        Intersection lightInter;
+        float pdf_light = 0.0f;
+        scene.sampleLight(lightInter, pdf_light, sampler);
+
+        const Vector3f& N = inter.normal;
+        const Vector3f& NN = lightInter.normal;
+        const Vector3f& objPos = inter.coords;
+
+        Vector3f diff = lightInter.coords - objPos;
+        Vector3f lightDir = diff.normalized();
+        float lightDistance = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
+        float cosTheta = dotProduct(lightDir, N);
+        float cosThetaLight = dotProduct(-lightDir, NN);
+        if (cosTheta > 0 && cosThetaLight > 0) {
+            Vector3f f_r = inter.m->eval(wi, lightDir, N);
+            shadowQueue.rays.emplace_back(objPos, lightDir);
+            shadowQueue.tMax.push_back(std::sqrt(lightDistance) - 1e-2f);
+            Vector3f Ld = lightInter.emit * f_r * cosTheta * cosThetaLight / lightDistance / pdf_light;
+            if (scene.mis)
+                Ld = Ld * powerHeuristic(pdf_light * lightDistance / cosThetaLight, inter.m->pdf(wi, lightDir, N));
+            shadowQueue.contribution.push_back(beta * Ld);
+            shadowQueue.pathId.push_back(id);
+        }
+
+        // 间接光照：俄罗斯轮盘赌决定是否继续弹射
+        if (sampler.get1D() < scene.RussianRoulette) {
+            Vector3f nextDir = inter.m->sample(wi, N, sampler).normalized();
+            float pdf = inter.m->pdf(wi, nextDir, N);
+            if (pdf <= 0.0f)
+                continue; // 采样方向落在表面以下，路径结束
+            Vector3f f_r = inter.m->eval(wi, nextDir, N);
+            next.push(objPos, nextDir, beta * (f_r * dotProduct(nextDir, N) / pdf / scene.RussianRoulette), pdf, id);
+        }
+    }
+}
+
+void WavefrontIntegrator::shadow()
+{
+    // 批量遮挡测试，并累加未被遮挡的直接光照
+    size_t n = shadowQueue.rays.size();
+    shadowQueue.occluded.resize(n);
+    scene.intersectP(shadowQueue.rays.data(), shadowQueue.tMax.data(), shadowQueue.occluded.data(), n);
+    for (size_t i = 0; i < n; ++i) {
+        if (!shadowQueue.occluded[i])
+            L[shadowQueue.pathId[i]] += shadowQueue.contribution[i];
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Scene.hpp"
+#include "Sampler.hpp"
+
+// 波前（wavefront）路径追踪：不再对每条路径递归调用 Scene::castRay，
+// 而是把一批路径的状态放进队列，按阶段对整批路径依次执行：
+//   extend     —— 对所有活动路径批量求交
+//   shade      —— 处理交点：光源采样生成阴影射线、俄罗斯轮盘赌、BSDF 采样生成下一段射线
+//   shadow     —— 对所有阴影射线批量做遮挡测试
+//   accumulate —— 把未被遮挡的直接光照累加到对应路径
+// 每条路径使用与 castRay 相同的随机数顺序，因此两者是同一个估计量，可以直接对比。
+// 注意“批量”目前只是阶段划分和接口：BVH 对一批光线仍逐条做单光线遍历，求交本身没有因批处理而变快。
+class WavefrontIntegrator
+{
+public:
+    explicit WavefrontIntegrator(const Scene& scene, size_t maxBatch = 1 << 16)
+        : scene(scene), maxBatch(maxBatch) {}
+
+    // 追踪一批主光线：第 i 条光线使用采样器 samplers[i]（调用者已按像素编号、采样编号播种，
+    // 并已用它生成了主光线），radiance[i] 为它的辐射度估计。
+    // primaryHits 非空时为每条主光线已知的交点，第一次 extend 不再求交
+    void trace(const std::vector<Ray>& rays,
+               std::vector<Sampler>& samplers,
+               std::vector<Vector3f>& radiance,
+               const std::vector<Intersection>* primaryHits = nullptr);
+
+private:
+    // 路径队列（SoA）：每个字段单独存放，便于各阶段批量处理
+    struct PathQueue
+    {
+        std::vector<Vector3f> origin;
+        std::vector<Vector3f> dir;
+        std::vector<Vector3f> throughput;
+        std::vector<float> bsdfPdf;   // 生成该段射线的 BSDF 采样 pdf（MIS 权重用，主光线为 0）
+        std::vector<uint32_t> pathId; // 路径编号，对应当前批次 radiance / samplers 中的位置
+
+        void clear()
+        {
+            origin.clear(); dir.clear(); throughput.clear(); bsdfPdf.clear(); pathId.clear();
+        }
+        size_t size() const { return pathId.size(); }
+        void push(const Vector3f& o, const Vector3f& d, const Vector3f& beta, float pdf, uint32_t id)
+        {
+            origin.push_back(o); dir.push_back(d); throughput.push_back(beta); bsdfPdf.push_back(pdf); pathId.push_back(id);
+        }
+    };
+
+    // 阴影射线队列（SoA）
+    struct ShadowQueue
+    {
+        std::vector<Ray> rays;
+        std::vector<float> tMax;
+        std::vector<Vector3f> contribution; // 未被遮挡时累加到路径上的直接光照
+        std::vector<uint32_t> pathId;
+        std::vector<char> occluded;
+
+        void clear()
+        {
+            rays.clear(); tMax.clear(); contribution.clear(); pathId.clear(); occluded.clear();
+        }
+    };
+
+    void traceBatch(const Ray* rays, Sampler* samplers, size_t count, Vector3f* radiance,
+                    const Intersection* primaryHits);
+    void extend();
+    void shade(int depth);
+    void shadow();
+
+    const Scene& scene;
+    size_t maxBatch; // 每批最多同时追踪的路径数
+
+    PathQueue current, next;
+    ShadowQueue shadowQueue;
+    std::vector<Ray> rayBuffer;
+    std::vector<Intersection> hits;
+    Sampler* samplers = nullptr;   // 当前批次每条路径的采样器，保证随机数顺序与 castRay 一致
+    Vector3f* L = nullptr;         // 当前批次每条路径的辐射度
+};
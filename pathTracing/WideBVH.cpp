@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include "WideBVH.hpp"
+#include "BVH.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define WIDEBVH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang 需要用 target 属性单独为 AVX2 函数开启指令集，MSVC 可以直接使用 intrinsics
+#if defined(WIDEBVH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define WIDEBVH_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define WIDEBVH_TARGET_AVX2
+#endif
+
+static SimdLevel queryCpu()
+{
+#if defined(WIDEBVH_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        // 还需要操作系统保存 YMM 寄存器
+        if (osxsave && avx && avx2 && (_xgetbv(0) & 6) == 6)
+            return SimdLevel::AVX2;
+    }
+    return SimdLevel::SSE;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    return SimdLevel::SSE;
+#endif
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = queryCpu();
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::SSE: return "SSE";
+    default: return "scalar";
+    }
+}
+
+// 光线起点与方向倒数，包围盒测试只需要这六个分量
+struct RayBoxData
+{
+    float ox, oy, oz;
+    float ix, iy, iz;
+};
+
+// 通用的逐个包围盒测试，返回相交的子节点掩码，tEnter 为各子节点的进入距离
+template <int N>
+static int boxTestScalar(const WideBVHNode<N>& node, const RayBoxData& r, float tMax, float* tEnter)
+{
+    int mask = 0;
+    for (int i = 0; i < N; ++i) {
+        float tx0 = (node.minX[i] - r.ox) * r.ix, tx1 = (node.maxX[i] - r.ox) * r.ix;
+        float ty0 = (node.minY[i] - r.oy) * r.iy, ty1 = (node.maxY[i] - r.oy) * r.iy;
+        float tz0 = (node.minZ[i] - r.oz) * r.iz, tz1 = (node.maxZ[i] - r.oz) * r.iz;
+        float t0 = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        float t1 = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+        tEnter[i] = t0;
+        if (t0 <= t1)
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+#if defined(WIDEBVH_X86)
+// SSE：一次测试 4 个包围盒
+static inline int boxTestSSE(const WideBVHNode<4>& node, const RayBoxData& r, float tMax, float* tEnter)
+{
+    __m128 ox = _mm_set1_ps(r.ox), oy = _mm_set1_ps(r.oy), oz = _mm_set1_ps(r.oz);
+    __m128 ix = _mm_set1_ps(r.ix), iy = _mm_set1_ps(r.iy), iz = _mm_set1_ps(r.iz);
+    __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), ox), ix);
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), ox), ix);
+    __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), oy), iy);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), oy), iy);
+    __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), oz), iz);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), oz), iz);
+    __m128 t0 = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                           _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+    __m128 t1 = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                           _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(tMax)));
+    _mm_storeu_ps(tEnter, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+
+// AVX2：一次测试 8 个包围盒，只有在运行时检测到 AVX2 后才会被调用
+WIDEBVH_TARGET_AVX2
+static int boxTestAVX2(const WideBVHNode<8>& node, const RayBoxData& r, float tMax, float* tEnter)
+{
+    __m256 ox = _mm256_set1_ps(r.ox), oy = _mm256_set1_ps(r.oy), oz = _mm256_set1_ps(r.oz);
+    __m256 ix = _mm256_set1_ps(r.ix), iy = _mm256_set1_ps(r.iy), iz = _mm256_set1_ps(r.iz);
+    __m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), ox), ix);
+    __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), ox), ix);
+    __m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), oy), iy);
+    __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), oy), iy);
+    __m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), oz), iz);
+    __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), oz), iz);
+    __m256 t0 = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)),
+                              _mm256_max_ps(_mm256_min_ps(tz0, tz1), _mm256_setzero_ps()));
+    __m256 t1 = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)),
+                              _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_set1_ps(tMax)));
+    _mm256_storeu_ps(tEnter, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+static inline int boxTest(const WideBVHNode<4>& node, const RayBoxData& r, float tMax, float* tEnter, SimdLevel simd)
+{
+#if defined(WIDEBVH_X86)
+    if (simd != SimdLevel::Scalar)
+        return boxTestSSE(node, r, tMax, tEnter);
+#endif
+    return boxTestScalar<4>(node, r, tMax, tEnter);
+}
+
+static inline int boxTest(const WideBVHNode<8>& node, const RayBoxData& r, float tMax, float* tEnter, SimdLevel simd)
+{
+#if defined(WIDEBVH_X86)
+    if (simd == SimdLevel::AVX2)
+        return boxTestAVX2(node, r, tMax, tEnter);
+#endif
+    return boxTestScalar<8>(node, r, tMax, tEnter);
+}
+
+template <int N>
+void WideBVH<N>::build(const std::vector<LinearBVHNode>& binaryNodes)
+{
+    nodes.clear();
+    maxStack = 1;
+    if (binaryNodes.empty())
+        return;
+    nodes.reserve(binaryNodes.size() / (N - 1) + 1);
+    collapse(binaryNodes, 0, 0);
+}
+
+template <int N>
+int WideBVH<N>::collapse(const std::vector<LinearBVHNode>& binaryNodes, int binaryIndex, int depth)
+{
+    maxStack = std::max(maxStack, (depth + 1) * (N - 1) + 1);
+    // 从该二叉节点的两个子节点开始，不断把表面积最大的内部子节点替换为它的两个子节点
+    int lanes[N];
+    int n = 0;
+    const LinearBVHNode& node = binaryNodes[binaryIndex];
+    if (node.nPrimitives > 0) {
+        lanes[n++] = binaryIndex; // 整棵树只有一个叶子
+    }
+    else {
+        lanes[n++] = binaryIndex + 1;
+        lanes[n++] = node.secondChildOffset;
+    }
+    while (n < N) {
+        int best = -1;
+        double bestArea = -1;
+        for (int i = 0; i < n; ++i) {
+            const LinearBVHNode& c = binaryNodes[lanes[i]];
+            if (c.nPrimitives == 0 && c.bounds.SurfaceArea() > bestArea) {
+                bestArea = c.bounds.SurfaceArea();
+                best = i;
+            }
+        }
+        if (best < 0)
+            break;
+        int expand = lanes[best];
+        lanes[best] = expand + 1;
+        lanes[n++] = binaryNodes[expand].secondChildOffset;
+    }
+
+    int myIndex = (int)nodes.size();
+    nodes.emplace_back();
+    for (int i = 0; i < N; ++i) {
+        WideBVHNode<N>& wide = nodes[myIndex];
+        wide.child[i] = -1;
+        wide.count[i] = 0;
+        if (i >= n) {
+            // 空槽：包围盒置零，遍历时根据 child/count 跳过
+            wide.minX[i] = wide.minY[i] = wide.minZ[i] = 0;
+            wide.maxX[i] = wide.maxY[i] = wide.maxZ[i] = 0;
+            continue;
+        }
+        const LinearBVHNode& c = binaryNodes[lanes[i]];
+        wide.minX[i] = c.bounds.pMin.x; wide.minY[i] = c.bounds.pMin.y; wide.minZ[i] = c.bounds.pMin.z;
+        wide.maxX[i] = c.bounds.pMax.x; wide.maxY[i] = c.bounds.pMax.y; wide.maxZ[i] = c.bounds.pMax.z;
+        if (c.nPrimitives > 0) {
+            wide.child[i] = c.primitivesOffset;
+            wide.count[i] = c.nPrimitives;
+        }
+        else {
+            // 递归过程中 nodes 可能扩容，因此先算出子节点位置再写回
+            int childIndex = collapse(binaryNodes, lanes[i], depth + 1);
+            nodes[myIndex].child[i] = childIndex;
+        }
+    }
+    return myIndex;
+}
+
+// 遍历栈放在栈上的项数，maxStack 超过它时改用堆上的栈
+static constexpr int kWideStackSize = 64;
+
+// 遍历栈中的一项：内部节点（count == 0）或叶子（物体区间），以及它的进入距离
+struct WideStackEntry
+{
+    int32_t child;
+    uint32_t count;
+    float t;
+};
+
+template <int N>
+Intersection WideBVH<N>::Intersect(const Ray& ray, const BVHAccel& accel) const
+{
+    Intersection isect;
+    if (nodes.empty())
+        return isect;
+
+    RayBoxData r{ ray.origin.x, ray.origin.y, ray.origin.z,
+                  ray.direction_inv.x, ray.direction_inv.y, ray.direction_inv.z };
+    float tClosest = std::numeric_limits<float>::infinity();
+
+    WideStackEntry stackBuffer[kWideStackSize * N];
+    std::unique_ptr<WideStackEntry[]> deepStack;
+    WideStackEntry* stack = stackBuffer;
+    if (maxStack > kWideStackSize * N) {
+        deepStack.reset(new WideStackEntry[maxStack]);
+        stack = deepStack.get();
+    }
+    int sp = 0;
+    stack[sp++] = { 0, 0, 0.0f };
+    while (sp > 0) {
+        WideStackEntry e = stack[--sp];
+        // 入栈之后找到了更近的交点，这一项可以直接跳过
+        if (e.t > tClosest)
+            continue;
+
+        if (e.count > 0) {
+            if (accel.intersectLeaf(ray, e.child, (int)e.count, isect))
+                tClosest = (float)isect.distance;
+            continue;
+        }
+
+        const WideBVHNode<N>& node = nodes[e.child];
+        alignas(32) float tEnter[N];
+        int mask = boxTest(node, r, tClosest, tEnter, simd);
+
+        // 相交的子节点按进入距离从远到近入栈，最近的最先出栈
+        WideStackEntry hits[N];
+        int n = 0;
+        for (int i = 0; i < N; ++i) {
+            if (!((mask >> i) & 1) || (node.count[i] == 0 && node.child[i] < 0))
+                continue;
+            WideStackEntry h{ node.child[i], node.count[i], tEnter[i] };
+            int k = n++;
+            while (k > 0 && hits[k - 1].t < h.t) {
+                hits[k] = hits[k - 1];
+                --k;
+            }
+            hits[k] = h;
+        }
+        for (int i = 0; i < n; ++i)
+            stack[sp++] = hits[i];
+    }
+    return isect;
+}
+
+template <int N>
+bool WideBVH<N>::IntersectP(const Ray& ray, float tMax, const BVHAccel& accel) const
+{
+    if (nodes.empty())
+        return false;
+
+    RayBoxData r{ ray.origin.x, ray.origin.y, ray.origin.z,
+                  ray.direction_inv.x, ray.direction_inv.y, ray.direction_inv.z };
+
+    WideStackEntry stackBuffer[kWideStackSize * N];
+    std::unique_ptr<WideStackEntry[]> deepStack;
+    WideStackEntry* stack = stackBuffer;
+    if (maxStack > kWideStackSize * N) {
+        deepStack.reset(new WideStackEntry[maxStack]);
+        stack = deepStack.get();
+    }
+    int sp = 0;
+    stack[sp++] = { 0, 0, 0.0f };
+    while (sp > 0) {
+        WideStackEntry e = stack[--sp];
+        if (e.count > 0) {
+            if (accel.occludedLeaf(ray, e.child, (int)e.count, tMax))
+                return true;
+            continue;
+        }
+
+        const WideBVHNode<N>& node = nodes[e.child];
+        alignas(32) float tEnter[N];
+        int mask = boxTest(node, r, tMax, tEnter, simd);
+        for (int i = 0; i < N; ++i) {
+            if (!((mask >> i) & 1) || (node.count[i] == 0 && node.child[i] < 0))
+                continue;
+            stack[sp++] = { node.child[i], node.count[i], tEnter[i] };
+        }
+    }
+    return false;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
@@ -0,0 +1,50 @@
+#ifndef RAYTRACING_WIDEBVH_H
+#define RAYTRACING_WIDEBVH_H
+
+#include <cstdint>
+#include <vector>
+#include "Object.hpp"
+#include "Ray.hpp"
+#include "Intersection.hpp"
+
+struct LinearBVHNode;
+class BVHAccel;
+
+// 运行时检测到的 SIMD 指令集
+enum class SimdLevel { Scalar, SSE, AVX2 };
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// N 叉 BVH 节点：N 个子节点的包围盒按分量分开存放（SoA），便于一次性用 SIMD 测试 N 个包围盒
+template <int N>
+struct alignas(32) WideBVHNode {
+    float minX[N], minY[N], minZ[N];
+    float maxX[N], maxY[N], maxZ[N];
+    int32_t child[N];  // count == 0 时为子节点在 nodes 中的位置（-1 表示空槽），否则为叶子中第一个物体的位置
+    uint32_t count[N]; // 叶子中的物体数量，0 表示内部节点或空槽
+};
+
+// 由二叉 BVH 折叠得到的 4 叉（SSE）/ 8 叉（AVX2）BVH，叶子与 BVHAccel 共用同一组物体，求交由 BVHAccel 的叶子函数完成
+template <int N>
+class WideBVH
+{
+public:
+    // 从压平的二叉 BVH 构建：每次展开表面积最大的内部子节点，直到凑满 N 个子节点
+    void build(const std::vector<LinearBVHNode>& binaryNodes);
+
+    // 最近交点查询
+    Intersection Intersect(const Ray& ray, const BVHAccel& accel) const;
+    // 遮挡查询：[0, tMax) 范围内有任意交点即返回 true
+    bool IntersectP(const Ray& ray, float tMax, const BVHAccel& accel) const;
+
+    std::vector<WideBVHNode<N> > nodes;
+    SimdLevel simd = SimdLevel::Scalar; // 包围盒测试使用的指令集
+    // 遍历栈最多同时容纳的项数：深度为 d 的内部节点出栈时，栈中还有每层祖先留下的至多 N - 1 个兄弟，
+    // 再压入至多 N 个子节点，因此为 (最大深度 + 1) * (N - 1) + 1
+    int maxStack = 1;
+
+private:
+    int collapse(const std::vector<LinearBVHNode>& binaryNodes, int binaryIndex, int depth);
+};
+
+#endif //RAYTRACING_WIDEBVH_H
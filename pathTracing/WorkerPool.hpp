@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 常驻工作线程池：线程只在构造时创建一次，之后每次 run 把同一个任务交给所有线程执行，
+// 并等待它们全部完成。渐进式渲染的每一遍、批量渲染的每一帧都复用同一组线程
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int numWorkers)
+    {
+        for (int w = 0; w < numWorkers; ++w)
+            threads.emplace_back([this, w]() { workerLoop(w); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            quit = true;
+        }
+        start.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // 在所有线程上执行 job(线程编号)，全部执行完后返回
+    void run(const std::function<void(int)>& job)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        this->job = &job;
+        running = (int)threads.size();
+        generation++;
+        start.notify_all();
+        done.wait(lock, [this]() { return running == 0; });
+        this->job = nullptr;
+    }
+
+    int size() const { return (int)threads.size(); }
+
+private:
+    void workerLoop(int worker)
+    {
+        unsigned long long seen = 0;
+        for (;;) {
+            const std::function<void(int)>* current;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                start.wait(lock, [&]() { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+                current = job;
+            }
+            (*current)(worker);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (--running == 0)
+                    done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable start, done;
+    const std::function<void(int)>* job = nullptr; // 当前任务
+    unsigned long long generation = 0;             // 每次 run 加一，线程据此判断是否有新任务
+    int running = 0;                               // 本次任务中还没执行完的线程数
+    bool quit = false;
+};
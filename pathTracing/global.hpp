@@ -2,6 +2,9 @@
 #include <iostream>
 #include <cmath>
 #include <random>
+#include <string>
+#include <filesystem>
+#include "Sampler.hpp"
 
 
 // 峣ͺ
@@ -34,14 +37,46 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
     return true;
 }
 
+// FNV-1a ϣ size ֽڵݻϣֵ hɳϣУֵ
+inline uint64_t hashBytes(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+template <typename T>
+inline uint64_t hashValue(uint64_t h, const T& v) { return hashBytes(h, &v, sizeof(T)); }
+
+// дõʱļ tmp 滻 pathдʱļ߲ῴдһļ
+// std::rename  Windows ϲܸѴڵļstd::filesystem::rename ڸƽ̨϶滻Ŀꣻʧʱɾʱļ
+inline bool replaceFile(const std::string& tmp, const std::string& path)
+{
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (!ec)
+        return true;
+    std::filesystem::remove(tmp, ec);
+    return false;
+}
+
+// ҪԲʽbeta = 2pdf Ϊ fPdf ĲԲɵ pdf Ϊ gPdf ĲʱȨ
+inline float powerHeuristic(float fPdf, float gPdf)
+{
+    float f = fPdf * fPdf, g = gPdf * gPdf;
+    return (f + g > 0.0f) ? f / (f + g) : 0.0f;
+}
+
 // һΧ[0, 1)֮
 inline float get_random_float()
 {
-    std::random_device dev;//
-    std::mt19937 rng(dev());
-    std::uniform_real_distribution<float> dist(0.f, 1.f); // distribution in range [1, 6]
-
-    return dist(rng);
+    // ÿ߳һ PCG32ÿεö std::random_device  std::mt19937
+    // ·׷ٱʹ Sampler Sampler.hppֻΪطͨ
+    static thread_local PCG32 rng(std::random_device{}());
+    return rng.nextFloat();
 }
 
 // ʾʾ
@@ -2,17 +2,204 @@
 #include "Scene.hpp"
 #include "Triangle.hpp"
 #include "Sphere.hpp"
+#include "Instance.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
 
 
+// 一个视角：相机参数和输出图像路径
+struct View
+{
+    Vector3f eye = Vector3f(278, 273, -800), lookAt = Vector3f(278, 273, 0), up = Vector3f(0, 1, 0);
+    float fov = 40;
+    int width = 784, height = 784;
+    float aperture = 0, focusDistance = 0;
+    std::string output = "binary.ppm";
+
+    Camera camera() const { return Camera(eye, lookAt, up, fov, width, height, aperture, focusDistance); }
+};
+
+// 解析一个视角相关的选项：不是视角选项时返回 -1，取值非法时返回 0，成功返回 1
+static int parseViewOption(const char* name, const char* value, View& view)
+{
+    auto parseVec = [](const char* s, Vector3f& v) { return sscanf(s, "%f,%f,%f", &v.x, &v.y, &v.z) == 3; };
+    if (!strcmp(name, "--res")) return sscanf(value, "%dx%d", &view.width, &view.height) == 2;
+    if (!strcmp(name, "--eye")) return parseVec(value, view.eye);
+    if (!strcmp(name, "--lookat")) return parseVec(value, view.lookAt);
+    if (!strcmp(name, "--up")) return parseVec(value, view.up);
+    if (!strcmp(name, "--fov")) { view.fov = atof(value); return 1; }
+    if (!strcmp(name, "--aperture")) { view.aperture = atof(value); return 1; }
+    if (!strcmp(name, "--focus")) { view.focusDistance = atof(value); return 1; }
+    if (!strcmp(name, "--output")) { view.output = value; return 1; }
+    return -1;
+}
+
+// 在路径的扩展名前插入帧编号：frame.ppm -> frame_0003.ppm
+static std::string indexedPath(const std::string& path, int index)
+{
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%04d", index);
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + suffix;
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+// 读取视角列表文件：每个非空、不以 # 开头的行是一个视角，写法与命令行中的视角选项相同，
+// 例如 "--eye 100,273,-800 --fov 35 --output left.ppm"，未给出的选项取 base 中的值。
+// 有多个视角时，没有给出 --output 的视角输出到 base.output 加上视角编号（binary_0002.ppm），不会互相覆盖
+static bool loadViews(const std::string& path, const View& base, std::vector<View>& views)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open view list " << path << "\n";
+        return false;
+    }
+    std::string line;
+    std::vector<bool> unnamed; // 每个视角是否没有给出 --output
+    for (int lineNo = 1; std::getline(in, line); ++lineNo) {
+        std::istringstream tokens(line);
+        std::string name, value;
+        if (!(tokens >> name) || name[0] == '#')
+            continue;
+        View view = base;
+        bool namedOutput = false;
+        do {
+            namedOutput = namedOutput || name == "--output";
+            if (!(tokens >> value) || parseViewOption(name.c_str(), value.c_str(), view) != 1) {
+                std::cerr << path << ":" << lineNo << ": invalid view option " << name << "\n";
+                return false;
+            }
+        } while (tokens >> name);
+        views.push_back(view);
+        unnamed.push_back(!namedOutput);
+    }
+    if (views.empty()) {
+        std::cerr << "View list " << path << " contains no views\n";
+        return false;
+    }
+    if (views.size() > 1) {
+        for (size_t v = 0; v < views.size(); ++v)
+            if (unnamed[v])
+                views[v].output = indexedPath(base.output, (int)v);
+    }
+    return true;
+}
+
 int main(int argc, char** argv)
 {
 
     // Change the definition here to change resolution
     Scene scene(784, 784);
 
+    //渲染器
+    Renderer r;
+
+    //命令行参数：--tile <分块边长>  --threads <线程数>  --wavefront <0|1>  --bvh <naive|sah|lbvh>  --leaf <叶子最大物体数>  --bvh-width <2|4|8>  --mesh-cache <0|1>  --diffuse <cosine|uniform>  --glossy <粗糙度，两个盒子改为 Microfacet 材质>  --mis <0|1>
+    //          --spp <每像素采样数>  --pass <渐进式渲染每遍采样数>  --time <时间预算（秒）>  --preview <预览间隔（秒）>  --output <输出路径>
+    //          --seed <采样器种子>  --sampler <sobol|independent>
+    //          --jitter <0|1>  --filter <box|tent|bh>  --filter-radius <像素>  --checkpoint <检查点路径>  --checkpoint-interval <秒>  --resume <0|1>
+    //          --adaptive <相对误差阈值>  --min-spp <自适应采样的最少采样数>
+    //          --res <宽x高>  --eye <x,y,z>  --lookat <x,y,z>  --up <x,y,z>  --fov <竖直视场角>  --aperture <透镜半径>  --focus <对焦距离>
+    //          --views <视角列表文件>  --turntable <帧数>：批量渲染，场景和 BVH 只加载、构建一次
+    //          --bunnies <个数>：在地面上放置共享同一网格和网格 BVH 的兔子实例
+    HemisphereSampling diffuseSampling = COSINE_HEMISPHERE;
+    float glossyRoughness = -1; // < 0 时两个盒子仍为漫反射材质
+    //相机参数（默认视角）
+    View base;
+    base.width = scene.width;
+    base.height = scene.height;
+    base.fov = scene.fov;
+    std::string viewList;
+    int turntableFrames = 0;
+    int numBunnies = 0;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::cerr << "Missing value for " << argv[i] << "\n";
+            return 1;
+        }
+        int ok = 1;
+        if (!strcmp(argv[i], "--tile")) r.tileSize = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--threads")) r.numThreads = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--spp")) r.spp = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--pass")) r.passSpp = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--time")) r.timeBudget = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--preview")) r.previewInterval = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--seed")) r.seed = strtoull(argv[i + 1], nullptr, 10);
+        else if (!strcmp(argv[i], "--sampler")) r.samplerType = strcmp(argv[i + 1], "independent") ? SOBOL_SAMPLER : INDEPENDENT_SAMPLER;
+        else if (!strcmp(argv[i], "--jitter")) r.jitter = atoi(argv[i + 1]) != 0;
+        else if (!strcmp(argv[i], "--filter")) r.filter = !strcmp(argv[i + 1], "tent") ? TENT_FILTER : !strcmp(argv[i + 1], "bh") ? BLACKMAN_HARRIS_FILTER : BOX_FILTER;
+        else if (!strcmp(argv[i], "--filter-radius")) r.filterRadius = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--checkpoint")) r.checkpoint = argv[i + 1];
+        else if (!strcmp(argv[i], "--checkpoint-interval")) r.checkpointInterval = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--resume")) r.resume = atoi(argv[i + 1]) != 0;
+        else if (!strcmp(argv[i], "--adaptive")) r.adaptiveThreshold = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--min-spp")) r.adaptiveMinSpp = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--wavefront")) r.wavefront = atoi(argv[i + 1]) != 0;
+        else if (!strcmp(argv[i], "--bvh")) scene.splitMethod = !strcmp(argv[i + 1], "sah") ? BVHAccel::SplitMethod::SAH : !strcmp(argv[i + 1], "lbvh") ? BVHAccel::SplitMethod::LBVH : BVHAccel::SplitMethod::NAIVE;
+        else if (!strcmp(argv[i], "--leaf")) scene.maxPrimsInNode = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--bvh-width")) scene.bvhWidth = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--mesh-cache")) scene.meshCache = atoi(argv[i + 1]) != 0;
+        else if (!strcmp(argv[i], "--mis")) scene.mis = atoi(argv[i + 1]) != 0;
+        else if (!strcmp(argv[i], "--glossy")) glossyRoughness = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--diffuse")) diffuseSampling = strcmp(argv[i + 1], "uniform") ? COSINE_HEMISPHERE : UNIFORM_HEMISPHERE;
+        else if (!strcmp(argv[i], "--views")) viewList = argv[i + 1];
+        else if (!strcmp(argv[i], "--turntable")) turntableFrames = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--bunnies")) numBunnies = atoi(argv[i + 1]);
+        else if ((ok = parseViewOption(argv[i], argv[i + 1], base)) < 0) {
+            std::cerr << "Unknown option: " << argv[i] << "\n";
+            return 1;
+        }
+        if (ok == 0) {
+            std::cerr << "Invalid value for " << argv[i] << ": " << argv[i + 1] << "\n";
+            return 1;
+        }
+    }
+
+    //要渲染的视角列表：视角列表文件中的每一行，或命令行给出的单个视角
+    std::vector<View> views;
+    if (viewList.empty())
+        views.push_back(base);
+    else if (!loadViews(viewList, base, views))
+        return 1;
+    //转台动画：每个视角展开为绕注视点（绕 y 轴）均匀旋转一周的 turntableFrames 帧
+    if (turntableFrames > 0) {
+        std::vector<View> frames;
+        for (const View& v : views) {
+            Vector3f offset = v.eye - v.lookAt;
+            for (int f = 0; f < turntableFrames; ++f) {
+                float angle = 2 * M_PI * f / turntableFrames;
+                View frame = v;
+                frame.eye = v.lookAt + Vector3f(offset.x * std::cos(angle) + offset.z * std::sin(angle), offset.y,
+                                                -offset.x * std::sin(angle) + offset.z * std::cos(angle));
+                frame.output = indexedPath(v.output, f);
+                frames.push_back(frame);
+            }
+        }
+        views.swap(frames);
+    }
+    //各视角（帧）的输出路径必须互不相同，否则后渲染的图像会覆盖先渲染的
+    std::set<std::string> outputs;
+    for (const View& v : views) {
+        if (!outputs.insert(v.output).second) {
+            std::cerr << "Several views write to " << v.output << "\n";
+            return 1;
+        }
+    }
+
     //对象（材质）
     Material* red = new Material(DIFFUSE, Vector3f(0.0f));
     red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
@@ -22,12 +209,21 @@ int main(int argc, char** argv)
     white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
     Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
     light->Kd = Vector3f(0.65f);
-    MeshTriangle floor("./models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("./models/cornellbox/shortbox.obj", white);
-    MeshTriangle tallbox("./models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("./models/cornellbox/left.obj", red);
-    MeshTriangle right("./models/cornellbox/right.obj", green);
-    MeshTriangle light_("./models/cornellbox/light.obj", light);
+    for (Material* mat : {red, green, white, light})
+        mat->diffuseSampling = diffuseSampling;
+    Material* box = white;
+    if (glossyRoughness >= 0) {
+        box = new Material(Microfacet, Vector3f(0.0f));
+        box->Kd = Vector3f(0.725f, 0.71f, 0.68f) * 0.5f;
+        box->Ks = Vector3f(0.45f);
+        box->roughness = glossyRoughness;
+    }
+    MeshTriangle floor("./models/cornellbox/floor.obj", white, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
+    MeshTriangle shortbox("./models/cornellbox/shortbox.obj", box, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
+    MeshTriangle tallbox("./models/cornellbox/tallbox.obj", box, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
+    MeshTriangle left("./models/cornellbox/left.obj", red, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
+    MeshTriangle right("./models/cornellbox/right.obj", green, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
+    MeshTriangle light_("./models/cornellbox/light.obj", light, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
 
     //场景添加对象
     scene.Add(&floor);
@@ -37,13 +233,61 @@ int main(int argc, char** argv)
     scene.Add(&right);
     scene.Add(&light_);
 
+    //兔子实例：网格只加载一次，每个实例绕 y 轴转过不同角度。两个盒子沿对角线占据了地面中部，
+    //兔子交替放在盒子两侧的两块空地上（矮盒右侧、高盒前方，以及高盒左侧、矮盒后方），每块空地内按网格状排布。
+    //兔子模型的尺寸只有零点几，先把原型缩放到场景的尺度（底面中心位于原点），三角形求交的阈值是按场景尺度设定的
+    std::unique_ptr<MeshTriangle> bunny;
+    std::vector<std::unique_ptr<Instance>> bunnies;
+    if (numBunnies > 0) {
+        bunny = std::make_unique<MeshTriangle>("./models/bunny/bunny.obj", white, scene.splitMethod, scene.maxPrimsInNode, scene.bvhWidth, scene.meshCache);
+        Bounds3 room = floor.getBounds(), low = shortbox.getBounds(), high = tallbox.getBounds();
+        const float margin = 10.0f;
+        Bounds3 openFloor[2] = {
+            Bounds3(Vector3f(low.pMax.x + margin, 0, room.pMin.z + margin), Vector3f(room.pMax.x - margin, 0, high.pMin.z - margin)),
+            Bounds3(Vector3f(room.pMin.x + margin, 0, low.pMax.z + margin), Vector3f(high.pMin.x - margin, 0, room.pMax.z - margin)),
+        };
+        int grid = (int)std::ceil(std::sqrt((float)((numBunnies + 1) / 2)));
+        float cell = std::numeric_limits<float>::max();
+        for (Bounds3& region : openFloor)
+            cell = std::min({ cell, region.Diagonal().x / grid, region.Diagonal().z / grid });
+
+        // 旋转后的兔子仍要留在自己的格子里：水平尺寸按格子边长的 0.7 倍缩放（对角线不超过边长）
+        Bounds3 b = bunny->getBounds();
+        Vector3f size = b.Diagonal();
+        float s = std::min(600.0f, 0.7f * cell / std::max(size.x, size.z));
+        Transform toScene = Transform::scale(Vector3f(s, s, s))
+                          * Transform::translate(Vector3f(-(b.pMin.x + b.pMax.x) / 2, -b.pMin.y, -(b.pMin.z + b.pMax.z) / 2));
+        std::vector<Vector3f> positions(bunny->vertices.get(), bunny->vertices.get() + bunny->numVertices);
+        for (Vector3f& p : positions)
+            p = toScene.point(p);
+        bunny->updateVertices(positions);
+        for (int k = 0; k < numBunnies; ++k) {
+            // 格子阵列在空地中居中
+            Bounds3& region = openFloor[k % 2];
+            Vector3f corner = region.Centroid() - Vector3f(cell * grid / 2, 0, cell * grid / 2);
+            int j = k / 2;
+            Vector3f position = corner + Vector3f(cell * (j % grid + 0.5f), 0, cell * (j / grid + 0.5f));
+            Transform toWorld = Transform::translate(position) * Transform::rotate(Vector3f(0, 1, 0), 47.0f * k);
+            bunnies.push_back(std::make_unique<Instance>(bunny.get(), toWorld));
+            scene.Add(bunnies.back().get());
+        }
+    }
+
     //构建加速结构
     scene.buildBVH();
 
-    //渲染器
-    Renderer r;
+    //逐个视角渲染，场景、BVH 和渲染器的工作线程在各帧之间复用
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);//渲染
+    std::string checkpoint = r.checkpoint;
+    for (size_t v = 0; v < views.size(); ++v) {
+        if (views.size() > 1)
+            std::cout << "\nView " << v + 1 << "/" << views.size() << ": " << views[v].output << "\n";
+        r.output = views[v].output;
+        if (!checkpoint.empty() && views.size() > 1)
+            r.checkpoint = indexedPath(checkpoint, (int)v); // 每个视角各自的检查点
+        if (!r.Render(scene, views[v].camera()))//渲染
+            return 1;
+    }
     auto stop = std::chrono::system_clock::now();
 
     std::cout << "Render complete: \n";